@@ -0,0 +1,443 @@
+#include "BatchRunner.h"
+#include "Formatting.h"
+#include "MappedFile.h"
+#include "Minifying.h"
+#include "TagRepair.h"
+#include "XmlSchema.h"
+#include "XmlTokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// verifyXML and the JSON converter are declared in their .cpp files,
+// included before this one in xml_editor.cpp
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static bool hasWildcard(const string &text)
+{
+    return text.find_first_of("*?") != string::npos;
+}
+
+// '*' matches any run of characters and '?' any single one
+static bool wildcardMatch(const string &pattern, const string &name)
+{
+    size_t p = 0, n = 0, star = string::npos, resume = 0;
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            ++p;
+            ++n;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            resume = n;
+        }
+        else if (star != string::npos)
+        {
+            p = star + 1;
+            n = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+    return p == pattern.size();
+}
+
+bool isBatchInput(const string &input)
+{
+    if (input.empty() || input == "-")
+        return false;
+    if (input[0] == '@' || hasWildcard(input))
+        return true;
+    error_code ec;
+    return fs::is_directory(input, ec);
+}
+
+// Deepest directory containing every path
+static fs::path commonDirectory(const vector<fs::path> &paths)
+{
+    if (paths.empty())
+        return fs::path();
+
+    fs::path common = paths[0].parent_path();
+    for (const fs::path &path : paths)
+    {
+        fs::path parent = path.parent_path();
+        fs::path shared;
+        auto a = common.begin(), b = parent.begin();
+        for (; a != common.end() && b != parent.end() && *a == *b; ++a, ++b)
+            shared /= *a;
+        common = shared;
+    }
+    return common;
+}
+
+bool collectBatchInputs(const string &input, vector<string> &files, string &root, string &error)
+{
+    error_code ec;
+    files.clear();
+
+    if (input[0] == '@')
+    {
+        ifstream list(input.substr(1));
+        if (!list.is_open())
+        {
+            error = "cannot read file list " + input.substr(1);
+            return false;
+        }
+
+        vector<fs::path> paths;
+        string line;
+        while (getline(list, line))
+        {
+            string_view path = trimWhitespace(line);
+            if (path.empty() || path[0] == '#')
+                continue;
+            paths.push_back(fs::absolute(fs::path(string(path)), ec).lexically_normal());
+        }
+        for (const fs::path &path : paths)
+            files.push_back(path.string());
+        root = commonDirectory(paths).string();
+        return true;
+    }
+
+    if (hasWildcard(input))
+    {
+        fs::path pattern(input);
+        fs::path directory = pattern.parent_path();
+        if (hasWildcard(directory.string()))
+        {
+            error = "wildcards are only supported in the file name";
+            return false;
+        }
+        if (directory.empty())
+            directory = ".";
+
+        string namePattern = pattern.filename().string();
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (it->is_regular_file(ec) && wildcardMatch(namePattern, it->path().filename().string()))
+                files.push_back(it->path().string());
+        }
+        if (ec)
+        {
+            error = "cannot list " + directory.string() + ": " + ec.message();
+            return false;
+        }
+        root = directory.string();
+        return true;
+    }
+
+    // Directories are searched recursively for .xml files
+    for (fs::recursive_directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (it->is_regular_file(ec) && it->path().extension() == ".xml")
+            files.push_back(it->path().string());
+    }
+    if (ec)
+    {
+        error = "cannot list " + input + ": " + ec.message();
+        return false;
+    }
+    root = input;
+    return true;
+}
+
+namespace
+{
+    struct BatchFile
+    {
+        string path;
+        fs::path output; // empty when the command writes nothing
+        size_t size;
+    };
+
+    struct BatchResult
+    {
+        bool ok = false;
+        bool valid = true;
+        bool repaired = false; // a fixed copy was written to the output path
+        size_t errorCount = 0;
+        size_t bytesOut = 0;
+        string message;
+    };
+
+    // Buffers owned by one worker and reused for every file it runs
+    struct BatchWorker
+    {
+        string output;
+    };
+
+    // One deque per worker. The owner takes from the front, so it works
+    // through its largest files first; an idle worker steals from the back
+    // of another deque, where the smallest files are.
+    class WorkStealingQueues
+    {
+    public:
+        explicit WorkStealingQueues(size_t workers) : queues(workers) {}
+
+        void push(size_t worker, size_t item) { queues[worker].items.push_back(item); }
+
+        bool take(size_t worker, size_t &item)
+        {
+            {
+                lock_guard<mutex> guard(queues[worker].lock);
+                if (!queues[worker].items.empty())
+                {
+                    item = queues[worker].items.front();
+                    queues[worker].items.pop_front();
+                    return true;
+                }
+            }
+            for (size_t step = 1; step < queues.size(); ++step)
+            {
+                Queue &victim = queues[(worker + step) % queues.size()];
+                lock_guard<mutex> guard(victim.lock);
+                if (!victim.items.empty())
+                {
+                    item = victim.items.back();
+                    victim.items.pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        struct Queue
+        {
+            mutex lock;
+            deque<size_t> items;
+        };
+        vector<Queue> queues;
+    };
+}
+
+static bool writeBatchOutput(const fs::path &path, string_view content, string &message)
+{
+    error_code ec;
+    if (path.has_parent_path())
+        fs::create_directories(path.parent_path(), ec);
+
+    ofstream out(path, ios::binary);
+    if (!out.is_open() || !out.write(content.data(), content.size()))
+    {
+        message = "cannot write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+static void runBatchFile(const CommandOptions &options, const XmlSchema *schema, const BatchFile &file, BatchWorker &worker,
+                         BatchResult &result)
+{
+    MappedFile input;
+    if (!input.open(file.path) || input.size() == 0)
+    {
+        result.message = "cannot read file";
+        return;
+    }
+    string_view xml = input.view();
+    worker.output.clear();
+
+    if (options.command == "verify")
+    {
+        VerifyOptions verifyOptions;
+        verifyOptions.failFast = options.failFast;
+        verifyOptions.maxErrors = 0; // only counted; a repair finds its own tags
+        verifyOptions.schema = schema;
+        VerifyResult verified = verifyXML(xml, verifyOptions);
+        result.valid = verified.valid;
+        result.errorCount = verified.errorCount + verified.schemaErrorCount;
+
+        if (verified.errorCount > 0 && !file.output.empty())
+        {
+            writeRepaired(xml, planTagRepairs(xml), worker.output);
+            if (!writeBatchOutput(file.output, worker.output, result.message))
+                return;
+            result.bytesOut = worker.output.size();
+            result.repaired = true;
+        }
+        result.ok = true;
+        return;
+    }
+
+    if (options.command == "format")
+    {
+        FormattingFunction(xml, worker.output, options.formatting);
+    }
+    else if (options.command == "mini")
+    {
+        MinifyingFunction(xml, worker.output, options.minifying);
+    }
+    else
+    {
+        XmlToJsonConverter converter(options.json);
+        converter.convertToJson(xml, worker.output);
+    }
+
+    if (!writeBatchOutput(file.output, worker.output, result.message))
+        return;
+    result.bytesOut = worker.output.size();
+    result.ok = true;
+}
+
+int runBatch(const CommandOptions &options)
+{
+    const string &command = options.command;
+    if (command != "verify" && command != "format" && command != "mini" && command != "json")
+    {
+        cerr << "Error: Batch mode supports verify, format, mini and json.\n";
+        return 1;
+    }
+
+    bool writesOutput = command != "verify" || options.fixErrors;
+    if (writesOutput && options.outputFile.empty())
+    {
+        cerr << "Error: Output directory not specified. Use -o <output_dir>.\n";
+        return 1;
+    }
+    if (options.failFast && options.fixErrors)
+    {
+        cerr << "Error: --fail-fast cannot be combined with -f.\n";
+        return 1;
+    }
+
+    // One compiled schema is shared read-only by every worker
+    XmlSchema compiledSchema;
+    const XmlSchema *schema = nullptr;
+    if (command == "verify" && !options.schemaFile.empty())
+    {
+        string error;
+        if (!loadSchema(options.schemaFile, compiledSchema, error))
+        {
+            cerr << "Error: Invalid schema: " << error << ".\n";
+            return 1;
+        }
+        schema = &compiledSchema;
+    }
+
+    vector<string> paths;
+    string root, error;
+    if (!collectBatchInputs(options.inputFile, paths, root, error))
+    {
+        cerr << "Error: " << error << ".\n";
+        return 1;
+    }
+    if (paths.empty())
+    {
+        cerr << "Error: No input files found for " << options.inputFile << ".\n";
+        return 1;
+    }
+
+    vector<BatchFile> files;
+    files.reserve(paths.size());
+    for (const string &path : paths)
+    {
+        error_code ec;
+        BatchFile file;
+        file.path = path;
+        uintmax_t size = fs::file_size(path, ec);
+        file.size = ec ? 0 : static_cast<size_t>(size);
+        if (writesOutput)
+        {
+            file.output = fs::path(options.outputFile) / fs::path(path).lexically_relative(root);
+            if (command == "json" && options.json.format == JsonFormat::Cbor)
+                file.output.replace_extension(".cbor");
+            else if (command == "json" && options.json.format == JsonFormat::MessagePack)
+                file.output.replace_extension(".msgpack");
+            else if (command == "json")
+                file.output.replace_extension(".json");
+        }
+        files.push_back(move(file));
+    }
+
+    // Largest files first, dealt round-robin, so every worker starts on
+    // big files and the small ones are left for balancing at the end
+    stable_sort(files.begin(), files.end(), [](const BatchFile &a, const BatchFile &b) { return a.size > b.size; });
+
+    // Only an unset count means every core, so --threads 1 runs one worker
+    size_t threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+    threads = min(threads, files.size());
+
+    WorkStealingQueues queues(threads);
+    for (size_t i = 0; i < files.size(); ++i)
+        queues.push(i % threads, i);
+
+    vector<BatchResult> results(files.size());
+    auto started = chrono::steady_clock::now();
+
+    auto work = [&](size_t id) {
+        BatchWorker worker;
+        size_t item;
+        while (queues.take(id, item))
+            runBatchFile(options, schema, files[item], worker, results[item]);
+    };
+    vector<thread> pool;
+    for (size_t id = 0; id < threads; ++id)
+        pool.emplace_back(work, id);
+    for (thread &t : pool)
+        t.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    // Summary, in input order so reports of the same batch compare equal
+    vector<size_t> order(files.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return files[a].path < files[b].path; });
+
+    size_t failed = 0, invalid = 0, totalErrors = 0, bytesIn = 0, bytesOut = 0;
+    for (size_t i : order)
+    {
+        const BatchResult &result = results[i];
+        bytesIn += files[i].size;
+        bytesOut += result.bytesOut;
+        if (!result.ok)
+        {
+            ++failed;
+            cout << files[i].path << ": failed, " << result.message << "\n";
+        }
+        else if (!result.valid)
+        {
+            ++invalid;
+            totalErrors += result.errorCount;
+            cout << files[i].path << ": invalid";
+            if (!options.failFast)
+                cout << ", " << result.errorCount << " errors";
+            // Schema errors alone leave nothing to repair
+            if (result.repaired)
+                cout << ", fixed in " << files[i].output.string();
+            cout << "\n";
+        }
+    }
+
+    double megabytes = bytesIn / (1024.0 * 1024.0);
+    cout << "Batch " << command << ": " << files.size() << " files, " << megabytes << " MB in "
+         << seconds << " s (" << (seconds > 0 ? megabytes / seconds : 0.0) << " MB/s) on " << threads << " threads\n";
+    cout << "Succeeded: " << files.size() - failed << ", failed: " << failed;
+    if (command == "verify")
+        cout << ", valid: " << files.size() - failed - invalid << ", invalid: " << invalid << ", errors: " << totalErrors;
+    cout << "\n";
+    if (writesOutput)
+        cout << "Output written under " << options.outputFile << " (" << bytesOut << " bytes)\n";
+
+    if (failed > 0 || (options.failFast && invalid > 0))
+        return 1;
+    return 0;
+}
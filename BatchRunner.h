@@ -0,0 +1,24 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include "EditorCommands.h"
+
+using namespace std;
+
+// True when input names several files: a directory, a wildcard pattern
+// such as "exports/*.xml", or "@list.txt" holding one path per line
+bool isBatchInput(const string &input);
+
+// Expands a batch input into files. root is the directory their relative
+// paths are taken from when outputs are mirrored.
+bool collectBatchInputs(const string &input, vector<string> &files, string &root, string &error);
+
+// Runs verify, format, mini or json over every file of a batch input on a
+// work-stealing thread pool. Outputs go to the same relative paths under
+// the -o directory, and one summary of the whole batch is printed.
+int runBatch(const CommandOptions &options);
+
+#endif
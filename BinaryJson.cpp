@@ -0,0 +1,349 @@
+#include "BinaryJson.h"
+#include "JsonEscape.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Slot of a size that is not known yet
+const size_t NO_SIZE_SLOT = SIZE_MAX;
+
+static bool isListed(const vector<string> &tags, string_view name)
+{
+    return find(tags.begin(), tags.end(), name) != tags.end();
+}
+
+// Whether a child named name joins the run of its previous sibling
+static bool continuesRun(bool hasChildren, string_view lastChild, string_view name)
+{
+    return hasChildren && lastChild == name;
+}
+
+void measureJsonContainers(string_view xml, vector<uint32_t> &sizes)
+{
+    struct Frame
+    {
+        size_t map;         // slot of the object, NO_SIZE_SLOT before the first child
+        size_t run;         // slot of the latest run, NO_SIZE_SLOT before the first child
+        uint32_t runLength;
+        string_view lastChild;
+    };
+
+    vector<Frame> open;
+    size_t skipped = 0;
+    bool hasRoot = false;
+    // The document object holds the root alone
+    sizes.assign(1, 0);
+
+    auto start = [&](string_view name) {
+        if (open.empty() && hasRoot)
+        {
+            ++skipped;
+            return;
+        }
+        if (open.empty())
+        {
+            sizes[0] = 1;
+        }
+        else
+        {
+            Frame &parent = open.back();
+            bool hasChildren = parent.map != NO_SIZE_SLOT;
+            if (continuesRun(hasChildren, parent.lastChild, name))
+            {
+                ++parent.runLength;
+            }
+            else
+            {
+                if (!hasChildren)
+                {
+                    parent.map = sizes.size();
+                    sizes.push_back(0);
+                }
+                else if (parent.run != NO_SIZE_SLOT)
+                {
+                    sizes[parent.run] = parent.runLength;
+                }
+                ++sizes[parent.map];
+                parent.run = sizes.size();
+                sizes.push_back(0);
+                parent.runLength = 1;
+                parent.lastChild = name;
+            }
+        }
+        open.push_back({NO_SIZE_SLOT, NO_SIZE_SLOT, 0, string_view()});
+        hasRoot = true;
+    };
+
+    auto end = [&]() {
+        if (skipped > 0)
+        {
+            --skipped;
+            return;
+        }
+        if (open.empty())
+            return;
+        if (open.back().run != NO_SIZE_SLOT)
+            sizes[open.back().run] = open.back().runLength;
+        open.pop_back();
+    };
+
+    XmlTokenizer tokenizer(xml);
+    XmlToken token;
+    while (tokenizer.next(token))
+    {
+        switch (token.type)
+        {
+        case XmlTokenType::StartTag:
+            start(token.name);
+            break;
+        case XmlTokenType::SelfClosingTag:
+            start(token.name);
+            end();
+            break;
+        case XmlTokenType::EndTag:
+            end();
+            break;
+        default:
+            break;
+        }
+    }
+    skipped = 0;
+    while (!open.empty())
+        end();
+}
+
+BinaryJsonWriter::BinaryJsonWriter(OutputBuffer &out, const JsonOptions &options, const vector<uint32_t> &sizes)
+    : out(out), arrayTags(options.arrayTags), format(options.format), sizes(sizes), next(0), depth(0),
+      pendingEntities(false), hasRoot(false), skipped(0)
+{
+    writeMapHead(nextSize());
+}
+
+void BinaryJsonWriter::writeBigEndian(uint64_t value, size_t bytes)
+{
+    char buffer[8];
+    for (size_t i = 0; i < bytes; ++i)
+        buffer[i] = char(value >> (8 * (bytes - 1 - i)));
+    out.write(buffer, bytes);
+}
+
+// Major type in the top three bits, the size in the low five when below
+// 24, else in the 1, 2, 4 or 8 bytes after
+void BinaryJsonWriter::writeCborHead(uint8_t major, uint64_t size)
+{
+    uint8_t type = uint8_t(major << 5);
+    if (size < 24)
+    {
+        out.put(char(type | size));
+    }
+    else if (size <= 0xFF)
+    {
+        out.put(char(type | 24));
+        writeBigEndian(size, 1);
+    }
+    else if (size <= 0xFFFF)
+    {
+        out.put(char(type | 25));
+        writeBigEndian(size, 2);
+    }
+    else if (size <= 0xFFFFFFFF)
+    {
+        out.put(char(type | 26));
+        writeBigEndian(size, 4);
+    }
+    else
+    {
+        out.put(char(type | 27));
+        writeBigEndian(size, 8);
+    }
+}
+
+// MessagePack sizes stop at 32 bits, past any single input we map
+void BinaryJsonWriter::writeStringHead(uint64_t size)
+{
+    if (format == JsonFormat::Cbor)
+    {
+        writeCborHead(3, size);
+        return;
+    }
+    if (size < 32)
+    {
+        out.put(char(0xA0 | size));
+    }
+    else if (size <= 0xFF)
+    {
+        out.put(char(0xD9));
+        writeBigEndian(size, 1);
+    }
+    else if (size <= 0xFFFF)
+    {
+        out.put(char(0xDA));
+        writeBigEndian(size, 2);
+    }
+    else
+    {
+        out.put(char(0xDB));
+        writeBigEndian(size, 4);
+    }
+}
+
+void BinaryJsonWriter::writeArrayHead(uint64_t size)
+{
+    if (format == JsonFormat::Cbor)
+    {
+        writeCborHead(4, size);
+        return;
+    }
+    if (size < 16)
+    {
+        out.put(char(0x90 | size));
+    }
+    else if (size <= 0xFFFF)
+    {
+        out.put(char(0xDC));
+        writeBigEndian(size, 2);
+    }
+    else
+    {
+        out.put(char(0xDD));
+        writeBigEndian(size, 4);
+    }
+}
+
+void BinaryJsonWriter::writeMapHead(uint64_t size)
+{
+    if (format == JsonFormat::Cbor)
+    {
+        writeCborHead(5, size);
+        return;
+    }
+    if (size < 16)
+    {
+        out.put(char(0x80 | size));
+    }
+    else if (size <= 0xFFFF)
+    {
+        out.put(char(0xDE));
+        writeBigEndian(size, 2);
+    }
+    else
+    {
+        out.put(char(0xDF));
+        writeBigEndian(size, 4);
+    }
+}
+
+void BinaryJsonWriter::writeString(string_view value, bool hasEntities)
+{
+    // Quotes, backslashes and control characters need no escaping here,
+    // but the clean prefix still ends at them
+    size_t clean = jsonCleanPrefix(value, hasEntities);
+    if (clean == value.size())
+    {
+        writeStringHead(value.size());
+        out.write(value);
+        return;
+    }
+    string_view rest = value.substr(clean);
+    if (decoded.size() < JSON_ESCAPE_GROWTH * rest.size())
+        decoded.resize(JSON_ESCAPE_GROWTH * rest.size());
+    size_t length = decodeXmlText(rest, &decoded[0], hasEntities);
+    writeStringHead(clean + length);
+    out.write(value.substr(0, clean));
+    out.write(decoded.data(), length);
+}
+
+void BinaryJsonWriter::consume(const XmlToken &token)
+{
+    switch (token.type)
+    {
+    case XmlTokenType::StartTag:
+        startElement(token.name);
+        break;
+    case XmlTokenType::SelfClosingTag:
+        startElement(token.name);
+        endElement();
+        break;
+    case XmlTokenType::EndTag:
+        endElement();
+        break;
+    case XmlTokenType::Text:
+    case XmlTokenType::CData:
+    {
+        bool isText = token.type == XmlTokenType::Text;
+        string_view value = isText ? trimWhitespace(token.raw) : cdataContent(token.raw);
+        // Only the innermost element can still turn out to be a scalar
+        if (!value.empty() && depth > 0 && !open[depth - 1].hasChildren)
+        {
+            pendingText = value;
+            pendingEntities = isText;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void BinaryJsonWriter::startElement(string_view name)
+{
+    if (depth == 0 && hasRoot)
+    {
+        ++skipped;
+        return;
+    }
+
+    if (depth > 0)
+    {
+        OpenElement &parent = open[depth - 1];
+        if (!continuesRun(parent.hasChildren, parent.lastChild, name))
+        {
+            // The first child makes the parent an object and drops its text
+            if (!parent.hasChildren)
+                writeMapHead(nextSize());
+            parent.hasChildren = true;
+            writeString(name, false);
+            // Listed tags are arrays even when they occur once
+            uint32_t length = nextSize();
+            if (length > 1 || isListed(arrayTags, name))
+                writeArrayHead(length);
+            parent.lastChild = name;
+        }
+    }
+    else
+    {
+        writeString(name, false);
+    }
+
+    if (depth == open.size())
+        open.emplace_back();
+    open[depth++] = {false, string_view()};
+    pendingText = string_view();
+    hasRoot = true;
+}
+
+void BinaryJsonWriter::endElement()
+{
+    if (skipped > 0)
+    {
+        --skipped;
+        return;
+    }
+    if (depth == 0)
+        return;
+
+    // Objects and arrays were written with their sizes, so only a scalar
+    // has anything left to write
+    if (!open[depth - 1].hasChildren)
+        writeString(pendingText, pendingEntities);
+    --depth;
+    pendingText = string_view();
+}
+
+void BinaryJsonWriter::finish()
+{
+    skipped = 0;
+    while (depth > 0)
+        endElement();
+}
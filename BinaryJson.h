@@ -0,0 +1,67 @@
+#ifndef BINARY_JSON_H
+#define BINARY_JSON_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OutputBuffer.h"
+#include "XmlTokenizer.h"
+#include "xml2json.h"
+
+using namespace std;
+
+// Sizes of the containers in the JSON form of xml, in the order their
+// headers are written: the document object, then the object of each
+// element with children, and before each run of same-name children the
+// length of that run. Found by a tokenizer pass that mirrors the grouping
+// of JsonEventWriter.
+void measureJsonContainers(string_view xml, vector<uint32_t> &sizes);
+
+// Writes the JSON form of an element tree as CBOR or MessagePack. Every
+// object, array and string is written with its size up front, so a reader
+// can skip or preallocate without scanning; container sizes come from
+// measureJsonContainers over the same input. Keys and values are slices of
+// the input, copied as they are unless they hold entities or bad UTF-8.
+class BinaryJsonWriter
+{
+public:
+    BinaryJsonWriter(OutputBuffer &out, const JsonOptions &options, const vector<uint32_t> &sizes);
+
+    void consume(const XmlToken &token);
+    void startElement(string_view name);
+    void endElement();
+    // Closes every element left open
+    void finish();
+
+private:
+    struct OpenElement
+    {
+        bool hasChildren;
+        string_view lastChild;
+    };
+
+    uint32_t nextSize() { return next < sizes.size() ? sizes[next++] : 0; }
+    void writeBigEndian(uint64_t value, size_t bytes);
+    void writeStringHead(uint64_t size);
+    void writeArrayHead(uint64_t size);
+    void writeMapHead(uint64_t size);
+    void writeCborHead(uint8_t major, uint64_t size);
+    void writeString(string_view value, bool hasEntities);
+
+    OutputBuffer &out;
+    const vector<string> &arrayTags;
+    JsonFormat format;
+    const vector<uint32_t> &sizes;
+    size_t next; // sizes already written
+    vector<OpenElement> open;
+    size_t depth;            // elements open, a prefix of open
+    string_view pendingText; // latest text of the innermost element
+    bool pendingEntities;
+    string decoded; // scratch for text that needs rewriting
+    bool hasRoot;
+    size_t skipped; // depth inside dropped top-level elements
+};
+
+#endif
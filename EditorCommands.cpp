@@ -0,0 +1,544 @@
+#include "EditorCommands.h"
+#include "BatchRunner.h"
+#include "Formatting.h"
+#include "Minifying.h"
+#include "TagRepair.h"
+#include "XmlSchema.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// Graph, compression, the consistency checks and the JSON converter are
+// declared in their .cpp files, included before this one in xml_editor.cpp
+
+using namespace std;
+
+CachedInput::~CachedInput() = default;
+
+static bool statFile(const string &path, FileStamp &stamp)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    stamp.size = info.st_size;
+#if defined(__linux__)
+    stamp.modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    stamp.modified = info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+    stamp.modified = info.st_mtime * 1000000000LL;
+#endif
+    return true;
+}
+
+CachedInput *InputCache::load(const string &path)
+{
+    // stdin can only be read once, so it is never reused
+    FileStamp stamp;
+    if (path != "-" && !statFile(path, stamp))
+    {
+        inputs.erase(path);
+        return nullptr;
+    }
+
+    auto found = inputs.find(path);
+    if (found != inputs.end() && path != "-" &&
+        found->second->stamp.size == stamp.size && found->second->stamp.modified == stamp.modified)
+        return found->second.get();
+    if (found != inputs.end() && found->second->edits > 0)
+        cerr << "Warning: " << path << " changed on disk; " << found->second->edits << " unsaved edits were discarded.\n";
+
+    unique_ptr<CachedInput> input(new CachedInput());
+    input->stamp = stamp;
+    if (!input->file.open(path))
+    {
+        inputs.erase(path);
+        return nullptr;
+    }
+
+    CachedInput *result = input.get();
+    inputs[path] = move(input);
+    return result;
+}
+
+bool InputCache::hasEdits(const string &path) const
+{
+    auto found = inputs.find(path);
+    return found != inputs.end() && found->second->edits > 0;
+}
+
+string_view InputCache::text(CachedInput &input)
+{
+    if (input.edits == 0)
+        return input.file.view();
+    if (input.editedTextStale)
+    {
+        input.editedText = input.verifier->text();
+        input.editedTextStale = false;
+    }
+    return input.editedText;
+}
+
+XmlDocument &InputCache::document(CachedInput &input)
+{
+    if (!input.document)
+        input.document.reset(new XmlDocument(text(input)));
+    return *input.document;
+}
+
+Graph &InputCache::graph(CachedInput &input)
+{
+    if (!input.graph)
+    {
+        input.graph.reset(new Graph(200));
+        input.graph->buildFromDocument(document(input));
+    }
+    return *input.graph;
+}
+
+IncrementalVerifier &InputCache::verifier(CachedInput &input)
+{
+    if (!input.verifier)
+        input.verifier.reset(new IncrementalVerifier(text(input)));
+    return *input.verifier;
+}
+
+void InputCache::applyEdit(CachedInput &input, size_t offset, size_t length, string_view replacement)
+{
+    verifier(input).applyEdit(offset, length, replacement);
+    ++input.edits;
+    // The text is copied out only when a command other than edit needs it
+    input.editedTextStale = true;
+    input.graph.reset();
+    input.document.reset();
+}
+
+vector<string> splitString(const string &input, char delimiter)
+{
+    vector<string> tokens;
+    stringstream ss(input);
+    string token;
+
+    while (getline(ss, token, delimiter))
+    {
+        tokens.push_back(token);
+    }
+
+    return tokens;
+}
+
+bool isGraphCommand(const string &command)
+{
+    return command == "draw" || command == "most_active" || command == "most_influencer" ||
+           command == "mutual" || command == "suggest" || command == "search";
+}
+
+// Runs a chunked command from a file or stdin ("-") to a file or stdout
+static int streamCommand(const function<void(istream &, ostream &)> &process, const string &inputFile, const string &outputFile, const string &description)
+{
+    ifstream inFile;
+    if (inputFile != "-")
+    {
+        inFile.open(inputFile, ios::binary);
+        if (!inFile.is_open())
+        {
+            cerr << "Error: Failed to read input file.\n";
+            return 1;
+        }
+    }
+    istream &in = (inputFile == "-") ? cin : inFile;
+
+    if (outputFile.empty() || outputFile == "-")
+    {
+        process(in, cout);
+        cout.flush();
+        return 0;
+    }
+
+    ofstream outFile(outputFile, ios::binary);
+    if (!outFile.is_open())
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    process(in, outFile);
+    cout << description << " saved to " << outputFile << "\n";
+    return 0;
+}
+
+// Formats straight into the output file's descriptor through one large
+// buffer, so the document is never held twice in memory
+static int runFormat(const CommandOptions &options, string_view xml)
+{
+    OutputBuffer output;
+    if (!output.openFile(options.outputFile))
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    FormatOptions formatting = options.formatting;
+    formatting.threads = max(1u, options.threads);
+    FormattingFunction(xml, output, formatting);
+    if (!output.close())
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    cout << "Formatted XML saved to " << options.outputFile << "\n";
+    return 0;
+}
+
+// Minified output is a list of ranges of the mapped input, written to the
+// file with writev without copying them
+static int runMinify(const CommandOptions &options, string_view xml)
+{
+    SpanWriter output;
+    if (!output.openFile(options.outputFile))
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    MinifyingFunction(xml, output, options.minifying);
+    if (!output.close())
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    cout << "Minified XML saved to " << options.outputFile << "\n";
+    return 0;
+}
+
+// JSON is written as the tokenizer reads the mapped input, with no tree
+static int runJson(const CommandOptions &options, string_view xml)
+{
+    OutputBuffer output;
+    XmlToJsonConverter converter(options.json);
+    if (!output.openFile(options.outputFile) || !converter.convertToJson(xml, output) || !output.close())
+    {
+        cerr << "Error: Failed to write to output file.\n";
+        return 1;
+    }
+    cout << "Converted " << jsonFormatName(options.json.format) << " saved to " << options.outputFile << "\n";
+    return 0;
+}
+
+static int runGraphCommand(const CommandOptions &options, Graph &network)
+{
+    const string &command = options.command;
+
+    if (command == "draw")
+    {
+        network.exportToDot("social_network.dot");
+
+        string pythonCommand = "python Graph_GUI.py";
+        if (!options.outputFile.empty())
+        {
+            pythonCommand += " -o \"" + options.outputFile + "\"";
+        }
+
+        // The renderer's messages go through cout so that serve mode can
+        // return them instead of letting them into its response stream
+        FILE *renderer = popen(pythonCommand.c_str(), "r");
+        if (renderer == nullptr)
+        {
+            cerr << "Failed to render graph with Python script.\n";
+            return 1;
+        }
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), renderer)) > 0)
+            cout.write(buffer, count);
+        if (pclose(renderer) != 0)
+        {
+            cerr << "Failed to render graph with Python script.\n";
+            return 1;
+        }
+    }
+    else if (command == "most_active")
+    {
+        User mostActiveUser = network.most_active();
+        cout << "Most Active User: " << mostActiveUser.name << " (ID: " << mostActiveUser.id << ")\n";
+    }
+    else if (command == "most_influencer")
+    {
+        User mostInfluencer = network.most_influencer();
+        cout << "Most Influential User: " << mostInfluencer.name << " (ID: " << mostInfluencer.id << ")\n";
+    }
+    else if (command == "mutual")
+    {
+        vector<User> mutualFollowers = network.findMutualFollowers(options.userIds);
+
+        cout << "Mutual Followers:\n";
+        for (const User &user : mutualFollowers)
+        {
+            cout << user.name << " (ID: " << user.id << ")\n";
+        }
+    }
+    else if (command == "suggest")
+    {
+        vector<User> suggestedUsers = network.suggestFollowers(options.userId);
+
+        cout << "Suggested Users:\n";
+        for (const User &user : suggestedUsers)
+        {
+            cout << user.name << " (ID: " << user.id << ")\n";
+        }
+    }
+    else if (command == "search")
+    {
+        if (options.searchTerm.empty())
+        {
+            cerr << "Search term not specified. Use -w <word> or -t <topic>.\n";
+            return 1;
+        }
+
+        vector<string> matchedPosts = network.searchPosts(options.searchTerm);
+
+        cout << "Posts mentioning the " << options.searchType << " \"" << options.searchTerm << "\":\n";
+        for (const string &post : matchedPosts)
+        {
+            cout << post << "\n";
+        }
+    }
+
+    return 0;
+}
+
+static void printSchemaErrors(const VerifyResult &result, size_t maxErrors)
+{
+    if (result.schemaErrorCount == 0)
+        return;
+
+    cout << "Number of schema errors: " << result.schemaErrorCount << "\n";
+    size_t listed = min(result.schemaErrors.size(), maxErrors);
+    for (size_t i = 0; i < listed; ++i)
+    {
+        const SchemaError &error = result.schemaErrors[i];
+        cout << "Schema error at line: " << error.line << ", column: " << error.column << ": " << error.message << "\n";
+    }
+    if (listed < result.schemaErrorCount)
+    {
+        cout << "(" << result.schemaErrorCount - listed << " more schema errors not listed)\n";
+    }
+}
+
+// Graph ingestion assumes the social network shape, so other documents are
+// turned away with their first errors instead of being read as empty users
+static bool checkGraphInput(const CommandOptions &options, string_view xml)
+{
+    XmlSchema schema;
+    string error;
+    if (!loadSchema(options.schemaFile.empty() ? "network" : options.schemaFile, schema, error))
+    {
+        cerr << "Error: Invalid schema: " << error << ".\n";
+        return false;
+    }
+
+    VerifyOptions verifyOptions;
+    verifyOptions.schema = &schema;
+    verifyOptions.maxErrors = 5;
+    VerifyResult result = verifyXML(xml, verifyOptions);
+    if (result.valid)
+        return true;
+
+    cerr << "Error: " << options.inputFile << " is not a social network document.\n";
+    for (const TagError &tagError : result.errors)
+    {
+        cerr << "Error at line: " << tagError.line << ", column: " << tagError.column << "\n";
+    }
+    for (const SchemaError &schemaError : result.schemaErrors)
+    {
+        cerr << "Schema error at line: " << schemaError.line << ", column: " << schemaError.column << ": " << schemaError.message << "\n";
+    }
+    size_t listed = result.errors.size() + result.schemaErrors.size();
+    size_t total = result.errorCount + result.schemaErrorCount;
+    if (listed < total)
+    {
+        cerr << "(" << total - listed << " more errors not listed)\n";
+    }
+    return false;
+}
+
+static int runVerify(const CommandOptions &options, string_view xml)
+{
+    if (options.failFast && options.fixErrors)
+    {
+        cerr << "Error: --fail-fast cannot be combined with -f.\n";
+        return 1;
+    }
+
+    XmlSchema schema;
+    if (!options.schemaFile.empty())
+    {
+        string error;
+        if (!loadSchema(options.schemaFile, schema, error))
+        {
+            cerr << "Error: Invalid schema: " << error << ".\n";
+            return 1;
+        }
+    }
+
+    VerifyOptions verifyOptions;
+    verifyOptions.failFast = options.failFast;
+    verifyOptions.threads = max(1u, options.threads);
+    verifyOptions.schema = options.schemaFile.empty() ? nullptr : &schema;
+    verifyOptions.maxErrors = options.maxErrors;
+
+    VerifyResult result = verifyXML(xml, verifyOptions);
+    if (result.valid)
+    {
+        cout << "Output: XML is valid.\n";
+        return 0;
+    }
+
+    cout << "Output: XML is invalid.\n";
+    if (options.failFast)
+    {
+        // The tag error, or the first schema error of a well-formed document
+        if (!result.errors.empty())
+        {
+            const TagError &error = result.errors.front();
+            cout << "First error at line: " << error.line << ", column: " << error.column << "\n";
+        }
+        else
+        {
+            const SchemaError &error = result.schemaErrors.front();
+            cout << "First error at line: " << error.line << ", column: " << error.column << ": " << error.message << "\n";
+        }
+        return 1;
+    }
+
+    // A document whose only problems are schema errors has no tag errors
+    if (result.errorCount > 0 || result.schemaErrorCount == 0)
+    {
+        cout << "Number of errors: " << result.errorCount << "\n";
+        size_t listed = min(result.errors.size(), options.maxErrors);
+        for (size_t i = 0; i < listed; ++i)
+        {
+            cout << "Error at line: " << result.errors[i].line << ", column: " << result.errors[i].column << "\n";
+        }
+        if (listed < result.errorCount)
+        {
+            cout << "(" << result.errorCount - listed << " more errors not listed)\n";
+        }
+    }
+    printSchemaErrors(result, options.maxErrors);
+
+    if (options.fixErrors && !options.outputFile.empty() && result.errorCount > 0)
+    {
+        ofstream outFile(options.outputFile);
+        if (!outFile.is_open())
+        {
+            cerr << "Error: Failed to write to output file.\n";
+            return 1;
+        }
+        writeRepaired(xml, planTagRepairs(xml), outFile);
+        cout << "Errors fixed. Corrected file saved as: " << options.outputFile << "\n";
+    }
+    return 0;
+}
+
+int runCommand(const CommandOptions &options, InputCache &cache)
+{
+    const string &command = options.command;
+
+    if (options.inputFile.empty())
+    {
+        cerr << "Error: Input file not specified. Use -i <input_file>.\n";
+        return 1;
+    }
+
+    if (isBatchInput(options.inputFile))
+        return runBatch(options);
+
+    // These read the file on disk, not the copy serve has edited
+    bool readsFile = command == "compress" || command == "decompress" ||
+                     (options.streamMode && (command == "format" || command == "mini" || command == "json"));
+    if (readsFile && cache.hasEdits(options.inputFile))
+    {
+        cerr << "Error: " << options.inputFile << " has unsaved edits, which " << command
+             << (options.streamMode ? " --stream" : "") << " would not see.\n";
+        return 1;
+    }
+
+    if (command == "compress" || command == "decompress")
+    {
+        if (options.outputFile.empty())
+        {
+            cerr << "Error: Output file not specified for " << (command == "compress" ? "compression" : "decompression") << ".\n";
+            return 1;
+        }
+        if (command == "compress")
+            compress(options.inputFile, options.outputFile);
+        else
+            decompress(options.inputFile, options.outputFile);
+        return 0;
+    }
+
+    if (options.streamMode && command == "format")
+    {
+        auto format = [&](istream &in, ostream &out) { FormattingStream(in, out, options.formatting); };
+        return streamCommand(format, options.inputFile, options.outputFile, "Formatted XML");
+    }
+    if (options.streamMode && command == "mini")
+    {
+        auto minify = [&](istream &in, ostream &out) { MinifyingStream(in, out, options.minifying); };
+        return streamCommand(minify, options.inputFile, options.outputFile, "Minified XML");
+    }
+    if (options.streamMode && command == "json")
+    {
+        // Container sizes are counted in a first pass over the whole input
+        if (options.json.format != JsonFormat::Text)
+        {
+            cerr << "Error: --stream only writes JSON text; " << jsonFormatName(options.json.format)
+                 << " needs the whole input.\n";
+            return 1;
+        }
+        XmlToJsonConverter converter(options.json);
+        auto convert = [&](istream &in, ostream &out) { converter.convertStream(in, out); };
+        return streamCommand(convert, options.inputFile, options.outputFile, "Converted JSON");
+    }
+
+    if (!isGraphCommand(command) && command != "verify" && command != "format" && command != "json" && command != "mini")
+    {
+        cerr << "Invalid command.\n";
+        return 1;
+    }
+
+    CachedInput *input = cache.load(options.inputFile);
+    if (input == nullptr || cache.text(*input).empty())
+    {
+        cerr << "Error: Failed to read input file.\n";
+        return 1;
+    }
+    string_view xml = cache.text(*input);
+
+    if (isGraphCommand(command))
+    {
+        // A cached graph was only built after its input passed the check
+        if ((!input->graph || !options.schemaFile.empty()) && !checkGraphInput(options, xml))
+            return 1;
+        return runGraphCommand(options, cache.graph(*input));
+    }
+
+    if (command == "verify")
+        return runVerify(options, xml);
+
+    if (command == "format")
+        return runFormat(options, xml);
+
+    if (command == "json")
+        return runJson(options, xml);
+
+    return runMinify(options, xml);
+}
@@ -0,0 +1,103 @@
+#ifndef EDITOR_COMMANDS_H
+#define EDITOR_COMMANDS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Formatting.h"
+#include "IncrementalVerifier.h"
+#include "MappedFile.h"
+#include "Minifying.h"
+#include "XmlDocument.h"
+#include "xml2json.h"
+
+using namespace std;
+
+class Graph;
+
+// Everything a single xml_editor command needs, filled from the command
+// line or from a serve request
+struct CommandOptions
+{
+    string command;
+    string inputFile;
+    string outputFile;
+    bool fixErrors = false;
+    bool streamMode = false;
+    unsigned threads = 0;        // 0 when not given: one for a file, every core for a batch
+    bool failFast = false;       // verify: stop at the first defect
+    size_t maxErrors = SIZE_MAX; // verify: errors listed, the rest only counted
+    string schemaFile;           // verify: schema file, or "network" for the built-in one
+    FormatOptions formatting;    // format: indentation and line ending
+    MinifyOptions minifying;     // mini: whether comments are kept
+    JsonOptions json;            // json: tags that are always arrays
+
+    vector<string> userIds; // mutual
+    string userId;          // suggest
+    string searchType;      // search: "word" or "topic"
+    string searchTerm;
+};
+
+// Size and modification time, used to tell whether a cached file is stale
+struct FileStamp
+{
+    long long size = -1;
+    long long modified = 0; // nanoseconds where the platform has them
+};
+
+// Input file with everything built from it so far. The document and graph
+// are built on first use and dropped together with the mapping. Once serve
+// has edited the input, the verifier holds the current text and every
+// command reads that instead of the file.
+struct CachedInput
+{
+    FileStamp stamp;
+    MappedFile file;
+    unique_ptr<XmlDocument> document;
+    unique_ptr<Graph> graph;
+    unique_ptr<IncrementalVerifier> verifier;
+    size_t edits = 0;        // edits applied since the file was loaded
+    string editedText;       // the edited text, copied out of the verifier
+    bool editedTextStale = false;
+
+    ~CachedInput();
+};
+
+// Inputs keyed by path. An entry is reused while the file on disk keeps
+// the same size and modification time, and reloaded otherwise; a reload
+// drops the edits made to the old copy and says so on cerr.
+class InputCache
+{
+public:
+    // Returns the entry for path, or nullptr if the file cannot be read
+    CachedInput *load(const string &path);
+    // Whether the cached copy of path has edits the file on disk lacks
+    bool hasEdits(const string &path) const;
+
+    // The input as commands see it: the file, or its edited copy
+    string_view text(CachedInput &input);
+    XmlDocument &document(CachedInput &input);
+    Graph &graph(CachedInput &input);
+    IncrementalVerifier &verifier(CachedInput &input);
+    // Replaces length bytes at offset and drops what was built from the old text
+    void applyEdit(CachedInput &input, size_t offset, size_t length, string_view replacement);
+
+    void clear() { inputs.clear(); }
+    size_t size() const { return inputs.size(); }
+
+private:
+    map<string, unique_ptr<CachedInput>> inputs;
+};
+
+vector<string> splitString(const string &input, char delimiter);
+
+bool isGraphCommand(const string &command);
+
+// Runs one command, writing its messages to cout and cerr. Returns the
+// process exit code.
+int runCommand(const CommandOptions &options, InputCache &cache);
+
+#endif
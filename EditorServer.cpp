@@ -0,0 +1,437 @@
+#include "EditorServer.h"
+#include "JsonEscape.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+
+using namespace std;
+
+string ServeRequest::get(const string &key) const
+{
+    auto found = fields.find(key);
+    return found == fields.end() ? string() : found->second;
+}
+
+namespace
+{
+    // Recursive-descent reader for the request subset of JSON
+    class RequestReader
+    {
+    public:
+        explicit RequestReader(string_view text) : text(text), pos(0) {}
+
+        bool read(ServeRequest &request, string &error)
+        {
+            skipSpace();
+            if (!consume('{'))
+                return fail(error, "expected '{'");
+
+            skipSpace();
+            if (consume('}'))
+                return finish(error);
+
+            while (true)
+            {
+                string key, value;
+                skipSpace();
+                if (!readString(key))
+                    return fail(error, "expected a member name");
+                skipSpace();
+                if (!consume(':'))
+                    return fail(error, "expected ':'");
+                skipSpace();
+
+                size_t valueStart = pos;
+                if (!readValue(value, true))
+                    return fail(error, "unsupported value for \"" + key + "\"");
+                if (key == "id")
+                    request.id = string(text.substr(valueStart, pos - valueStart));
+                request.fields[key] = value;
+
+                skipSpace();
+                if (consume('}'))
+                    return finish(error);
+                if (!consume(','))
+                    return fail(error, "expected ',' or '}'");
+            }
+        }
+
+    private:
+        bool fail(string &error, const string &message)
+        {
+            error = message + " at column " + to_string(pos + 1);
+            return false;
+        }
+
+        bool finish(string &error)
+        {
+            skipSpace();
+            if (pos != text.size())
+                return fail(error, "unexpected data after the request");
+            return true;
+        }
+
+        void skipSpace()
+        {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n'))
+                ++pos;
+        }
+
+        bool consume(char ch)
+        {
+            if (pos < text.size() && text[pos] == ch)
+            {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+
+        bool consumeWord(string_view word)
+        {
+            if (text.substr(pos, word.size()) != word)
+                return false;
+            pos += word.size();
+            return true;
+        }
+
+        bool readValue(string &value, bool allowArray)
+        {
+            if (pos >= text.size())
+                return false;
+
+            char ch = text[pos];
+            if (ch == '"')
+                return readString(value);
+            if (ch == '[' && allowArray)
+                return readArray(value);
+            if (consumeWord("true"))
+            {
+                value = "true";
+                return true;
+            }
+            if (consumeWord("false"))
+            {
+                value = "false";
+                return true;
+            }
+            if (consumeWord("null"))
+            {
+                value.clear();
+                return true;
+            }
+
+            size_t start = pos;
+            while (pos < text.size() && (isdigit(static_cast<unsigned char>(text[pos])) ||
+                                         text[pos] == '-' || text[pos] == '+' || text[pos] == '.' ||
+                                         text[pos] == 'e' || text[pos] == 'E'))
+                ++pos;
+            value = string(text.substr(start, pos - start));
+            return pos > start;
+        }
+
+        bool readArray(string &value)
+        {
+            ++pos; // '['
+            value.clear();
+            skipSpace();
+            if (consume(']'))
+                return true;
+
+            while (true)
+            {
+                string element;
+                skipSpace();
+                if (!readValue(element, false))
+                    return false;
+                if (!value.empty())
+                    value += ',';
+                value += element;
+
+                skipSpace();
+                if (consume(']'))
+                    return true;
+                if (!consume(','))
+                    return false;
+            }
+        }
+
+        bool readHex(unsigned &code)
+        {
+            if (pos + 4 > text.size())
+                return false;
+            code = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char ch = text[pos++];
+                code <<= 4;
+                if (ch >= '0' && ch <= '9')
+                    code |= ch - '0';
+                else if (ch >= 'a' && ch <= 'f')
+                    code |= ch - 'a' + 10;
+                else if (ch >= 'A' && ch <= 'F')
+                    code |= ch - 'A' + 10;
+                else
+                    return false;
+            }
+            return true;
+        }
+
+        static void appendUtf8(string &out, unsigned code)
+        {
+            if (code < 0x80)
+            {
+                out += static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool readString(string &value)
+        {
+            if (!consume('"'))
+                return false;
+
+            value.clear();
+            while (pos < text.size())
+            {
+                char ch = text[pos++];
+                if (ch == '"')
+                    return true;
+                if (ch != '\\')
+                {
+                    value += ch;
+                    continue;
+                }
+                if (pos >= text.size())
+                    return false;
+
+                char escape = text[pos++];
+                switch (escape)
+                {
+                case '"': value += '"'; break;
+                case '\\': value += '\\'; break;
+                case '/': value += '/'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'n': value += '\n'; break;
+                case 'r': value += '\r'; break;
+                case 't': value += '\t'; break;
+                case 'u':
+                {
+                    unsigned code;
+                    if (!readHex(code))
+                        return false;
+                    // A high surrogate is combined with the low one after it
+                    if (code >= 0xD800 && code < 0xDC00 && consumeWord("\\u"))
+                    {
+                        unsigned low;
+                        if (!readHex(low) || low < 0xDC00 || low >= 0xE000)
+                            return false;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(value, code);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        string_view text;
+        size_t pos;
+    };
+}
+
+bool parseServeRequest(string_view line, ServeRequest &request, string &error)
+{
+    request.fields.clear();
+    request.id.clear();
+    return RequestReader(line).read(request, error);
+}
+
+static bool isTrue(const string &value)
+{
+    return value == "true" || value == "1";
+}
+
+static void fillOptions(const ServeRequest &request, CommandOptions &options)
+{
+    options.command = request.get("command");
+    options.inputFile = request.get("input");
+    options.outputFile = request.get("output");
+    options.fixErrors = isTrue(request.get("fix"));
+    options.streamMode = isTrue(request.get("stream"));
+    if (request.has("threads"))
+        options.threads = max(1, atoi(request.get("threads").c_str()));
+    options.failFast = isTrue(request.get("fail_fast"));
+    if (request.has("max_errors"))
+        options.maxErrors = strtoull(request.get("max_errors").c_str(), nullptr, 10);
+    options.schemaFile = request.get("schema");
+    if (request.has("indent"))
+        options.formatting.indentWidth = unsigned(atoi(request.get("indent").c_str()));
+    if (request.get("indent_char") == "tab")
+        options.formatting.indentChar = '\t';
+    if (request.get("newline") == "crlf")
+        options.formatting.newline = "\r\n";
+    options.minifying.stripComments = isTrue(request.get("strip_comments"));
+    if (request.has("array_tags"))
+        options.json.arrayTags = splitString(request.get("array_tags"), ',');
+
+    if (request.has("ids"))
+        options.userIds = splitString(request.get("ids"), ',');
+    options.userId = request.get("user");
+    if (request.has("word"))
+    {
+        options.searchType = "word";
+        options.searchTerm = request.get("word");
+    }
+    else if (request.has("topic"))
+    {
+        options.searchType = "topic";
+        options.searchTerm = request.get("topic");
+    }
+}
+
+// Applies an edit to the cached copy of the input and reports its
+// consistency the way verify does
+static int runEdit(const ServeRequest &request, InputCache &cache)
+{
+    CachedInput *input = cache.load(request.get("input"));
+    if (input == nullptr)
+    {
+        cerr << "Error: Failed to read input file.\n";
+        return 1;
+    }
+
+    if (request.has("offset"))
+    {
+        size_t offset = strtoull(request.get("offset").c_str(), nullptr, 10);
+        size_t length = strtoull(request.get("length").c_str(), nullptr, 10);
+        cache.applyEdit(*input, offset, length, request.get("text"));
+    }
+    IncrementalVerifier &verifier = cache.verifier(*input);
+
+    if (verifier.isValid())
+    {
+        cout << "Output: XML is valid.\n";
+        return 0;
+    }
+
+    vector<TagError> errors = verifier.errors();
+    cout << "Output: XML is invalid.\n";
+    cout << "Number of errors: " << errors.size() << "\n";
+    for (const TagError &error : errors)
+    {
+        cout << "Error at line: " << error.line << ", column: " << error.column << "\n";
+    }
+    return 0;
+}
+
+static int handleRequest(const ServeRequest &request, InputCache &cache)
+{
+    string command = request.get("command");
+    if (request.get("input") == "-")
+    {
+        cerr << "Error: stdin carries the requests in serve mode.\n";
+        return 1;
+    }
+
+    if (command == "edit")
+        return runEdit(request, cache);
+
+    CommandOptions options;
+    fillOptions(request, options);
+    if (request.has("format") && !parseJsonFormat(request.get("format"), options.json.format))
+    {
+        cerr << "Error: Unknown format " << request.get("format") << ", expected json, cbor or msgpack.\n";
+        return 1;
+    }
+    return runCommand(options, cache);
+}
+
+// Points a stream at another buffer until it goes out of scope
+class StreamRedirect
+{
+public:
+    StreamRedirect(ostream &stream, streambuf *buffer) : stream(stream), saved(stream.rdbuf(buffer)) {}
+    ~StreamRedirect() { stream.rdbuf(saved); }
+
+    StreamRedirect(const StreamRedirect &) = delete;
+    StreamRedirect &operator=(const StreamRedirect &) = delete;
+
+private:
+    ostream &stream;
+    streambuf *saved;
+};
+
+int serveRequests(istream &requests, ostream &responses, InputCache &cache)
+{
+    string line;
+    while (getline(requests, line))
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        ServeRequest request;
+        string error;
+        bool parsed = parseServeRequest(line, request, error);
+        if (parsed && request.get("command") == "exit")
+            break;
+
+        // Commands report through cout and cerr, which are captured for
+        // the duration of the request
+        ostringstream out, err;
+        int status = 1;
+        {
+            StreamRedirect captureOut(cout, out.rdbuf());
+            StreamRedirect captureErr(cerr, err.rdbuf());
+            try
+            {
+                if (parsed)
+                    status = handleRequest(request, cache);
+                else
+                    cerr << "Error: Invalid request: " << error << "\n";
+            }
+            catch (const exception &failure)
+            {
+                status = 1;
+                cerr << "Error: " << failure.what() << "\n";
+            }
+        }
+
+        string response = "{";
+        if (!request.id.empty())
+            response += "\"id\": " + request.id + ", ";
+        response += "\"status\": " + to_string(status) + ", \"stdout\": ";
+        appendJsonString(response, out.str());
+        response += ", \"stderr\": ";
+        appendJsonString(response, err.str());
+        response += "}\n";
+
+        responses << response;
+        responses.flush();
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef EDITOR_SERVER_H
+#define EDITOR_SERVER_H
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "EditorCommands.h"
+
+using namespace std;
+
+// One request line: a flat JSON object whose values are strings, numbers,
+// booleans or arrays of those. Arrays are joined with ','.
+struct ServeRequest
+{
+    map<string, string> fields;
+    string id; // raw JSON of the "id" member, echoed back in the response
+
+    string get(const string &key) const;
+    bool has(const string &key) const { return fields.count(key) != 0; }
+};
+
+// Parses line into request, returns false with a message in error otherwise
+bool parseServeRequest(string_view line, ServeRequest &request, string &error);
+
+// Answers line-delimited JSON requests until "exit" or end of input.
+//
+//   {"id": 1, "command": "verify", "input": "a.xml", "threads": 4}
+//   {"id": 2, "command": "format", "input": "a.xml", "output": "b.xml"}
+//   {"id": 3, "command": "mutual", "input": "net.xml", "ids": ["1", "2"]}
+//   {"id": 4, "command": "edit", "input": "a.xml", "offset": 10, "length": 3, "text": "<b>"}
+//
+// Other members mirror the command-line flags: "fix", "stream",
+// "fail_fast", "max_errors", "schema", "indent", "indent_char" ("tab"),
+// "newline" ("crlf"), "strip_comments", "array_tags", "format" ("cbor" or
+// "msgpack"), "user" (suggest), "word" and "topic" (search). Each response
+// is one line,
+//
+//   {"id": 1, "status": 0, "stdout": "...", "stderr": "..."}
+//
+// holding the exit code and output the command would have produced on its
+// own. Inputs stay cached in cache between requests; "edit" changes the
+// in-memory copy of an input and re-verifies only the chunks it touches.
+// Later commands on that input read the edited copy, except --stream,
+// compress and decompress, which read the file and are refused. If the
+// file changes on disk, the copy is reloaded and the edits are dropped
+// with a warning.
+int serveRequests(istream &requests, ostream &responses, InputCache &cache);
+
+#endif
@@ -1,83 +1,255 @@
-#include <iostream>
-#include <string>
-#include <sstream>
-#include <stack>
-#include <fstream>
-#include <cctype>
-
-using namespace std;
-
-// Function to Format XML content
-string FormattingFunction(const string& input) {
-    string output;
-    stack<string> tagStack; // Stack to track tags for indentation
-    string currentTag;      // Temporary storage for current tag
-    bool insideTag = false; // To check if parsing inside a tag
-    int indentationLevel = 0;
-
-    for (size_t i = 0; i < input.size(); ++i) {
-        char ch = input[i];
-
-        if (ch == '<') {
-            // Start of a tag
-            if (!currentTag.empty()) {
-                // If there's text content, write it with proper indentation
-                if (!output.empty() && output.back() != '\n') {
-                    output += '\n';
-                }
-                output += string(indentationLevel * 4, ' ') + currentTag + '\n';
-                currentTag.clear();
-            }
-            insideTag = true;
-            currentTag += ch;
-        } else if (ch == '>') {
-            // End of a tag
-            insideTag = false;
-            currentTag += ch;
-
-            if (currentTag[1] == '/') {
-                // Closing tag
-                if (!tagStack.empty()) {
-                    tagStack.pop();
-                    indentationLevel--; // Reduce indentation level
-                }
-                output += string(indentationLevel * 2, ' ') + currentTag + '\n';
-            } else {
-                // Opening tag or self-closing tag
-                size_t spacePos = currentTag.find(' ');
-                string tagName = (spacePos != string::npos)
-                                     ? currentTag.substr(1, spacePos - 1)
-                                     : currentTag.substr(1, currentTag.size() - 2);
-
-                if (currentTag.back() == '/') {
-                    // Self-closing tag
-                    output += string(indentationLevel * 2, ' ') + currentTag + '\n';
-                } else {
-                    // Opening tag
-                    output += string(indentationLevel * 2, ' ') + currentTag + '\n';
-                    tagStack.push(tagName);
-                    indentationLevel++;
-                }
-            }
-            currentTag.clear();
-        } else if (insideTag) {
-            // Inside a tag, continue building it
-            currentTag += ch;
-        } else {
-            // Outside of tags, handle text content
-            if (!isspace(static_cast<unsigned char>(ch)) || (!output.empty() && output.back() != '\n')) {
-                currentTag += ch;
-            }
-        }
-    }
-
-    // Add any remaining content in `currentTag` to the output
-    if (!currentTag.empty()) {
-        if (!output.empty() && output.back() != '\n') {
-            output += '\n';
-        }
-        output += string(indentationLevel * 2, ' ') + currentTag + '\n';
-    }
-
-    return output;
-}
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Formatting.h"
+#include "XmlTokenizer.h"
+
+using namespace std;
+
+// Levels covered by one copy of the slab; deeper lines copy it more than once
+const size_t INDENT_SLAB_LEVELS = 64;
+
+XmlFormatter::XmlFormatter(OutputBuffer& output, const FormatOptions& options)
+    : output(output),
+      indentSlab(options.newline + string(INDENT_SLAB_LEVELS * options.indentWidth, options.indentChar)),
+      newlineSize(options.newline.size()),
+      lineBreak(0),
+      indentWidth(options.indentWidth),
+      indentationLevel(0) {}
+
+void XmlFormatter::writeLine(string_view text) {
+    size_t indent = indentationLevel * indentWidth;
+    size_t slabIndent = indentSlab.size() - newlineSize;
+    const char* start = indentSlab.data() + newlineSize - lineBreak;
+    if (indent <= slabIndent) {
+        output.write(start, lineBreak + indent);
+    } else {
+        output.write(start, lineBreak + slabIndent);
+        for (indent -= slabIndent; indent > slabIndent; indent -= slabIndent) {
+            output.write(indentSlab.data() + newlineSize, slabIndent);
+        }
+        output.write(indentSlab.data() + newlineSize, indent);
+    }
+    output.write(text);
+    lineBreak = newlineSize;
+}
+
+void XmlFormatter::resume(size_t level, bool lineStarted) {
+    indentationLevel = level;
+    lineBreak = lineStarted ? newlineSize : 0;
+}
+
+void XmlFormatter::finish() {
+    output.write(indentSlab.data() + newlineSize - lineBreak, lineBreak);
+    lineBreak = 0;
+}
+
+void XmlFormatter::consume(const XmlToken& token) {
+    switch (token.type) {
+    case XmlTokenType::Text: {
+        // Text content is written on its own line with proper indentation
+        string_view text = trimWhitespace(token.raw);
+        if (!text.empty()) {
+            writeLine(text);
+        }
+        break;
+    }
+    case XmlTokenType::EndTag:
+        // Closing tag
+        if (indentationLevel > 0) {
+            indentationLevel--; // Reduce indentation level
+        }
+        writeLine(token.raw);
+        break;
+    case XmlTokenType::StartTag:
+        // Opening tag
+        writeLine(token.raw);
+        indentationLevel++;
+        break;
+    default:
+        // Self-closing tags, comments and declarations keep the current level
+        writeLine(token.raw);
+        break;
+    }
+}
+
+// Function to Format XML content
+string FormattingFunction(string_view input, const FormatOptions& options) {
+    string output;
+    FormattingFunction(input, output, options);
+    return output;
+}
+
+void FormattingFunction(string_view input, string& output, const FormatOptions& options) {
+    OutputBuffer buffer(output);
+    FormattingFunction(input, buffer, options);
+}
+
+// Documents below this size are formatted on one thread
+const size_t MIN_PARALLEL_FORMAT_SIZE = 1 << 20;
+
+// How a range changes the indentation level: level L before the range
+// becomes max(L + add, floor) after it, since closing tags stop at zero
+struct LevelChange {
+    long long add = 0;
+    long long floor = 0;
+    bool writes = false; // range writes at least one line
+    bool cut = false;    // range ends inside a token
+};
+
+static LevelChange scanLevelChange(string_view range, bool lastRange) {
+    LevelChange change;
+    StructuralScanner scanner(range);
+    XmlToken token;
+    size_t pos = 0;
+
+    while (scanXmlToken(range, pos, lastRange, token, &scanner)) {
+        if (token.type == XmlTokenType::StartTag) {
+            change.add++;
+            change.floor++;
+        } else if (token.type == XmlTokenType::EndTag) {
+            change.add--;
+            change.floor = max(change.floor - 1, 0LL);
+        }
+        if (token.type != XmlTokenType::Text || !trimWhitespace(token.raw).empty()) {
+            change.writes = true;
+        }
+    }
+
+    // Text at the end is left for the next range to read, markup is cut
+    if (pos < range.size()) {
+        if (range[pos] == '<') {
+            change.cut = true;
+        } else if (!trimWhitespace(range.substr(pos)).empty()) {
+            change.writes = true;
+        }
+    }
+    return change;
+}
+
+// Formats ranges of the document concurrently. A first pass over every
+// range finds its level change, which gives the exact level each range
+// starts at; a second formats the ranges from there. Finished ranges are
+// written in order while later ones are still being formatted.
+static bool formatParallel(string_view input, OutputBuffer& output, const FormatOptions& options) {
+    vector<size_t> bounds = splitAtMarkup(input, size_t(options.threads) * 4);
+    size_t chunks = bounds.size() - 1;
+    size_t threads = min<size_t>(options.threads, chunks);
+    auto range = [&](size_t i) { return input.substr(bounds[i], bounds[i + 1] - bounds[i]); };
+
+    vector<LevelChange> changes(chunks);
+    atomic<size_t> nextChunk(0);
+    auto scan = [&]() {
+        for (size_t i = nextChunk++; i < chunks; i = nextChunk++) {
+            changes[i] = scanLevelChange(range(i), i + 1 == chunks);
+        }
+    };
+    vector<thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back(scan);
+    }
+    for (thread& t : pool) {
+        t.join();
+    }
+    pool.clear();
+
+    // A split inside a comment or tag cannot be formatted on its own
+    for (const LevelChange& change : changes) {
+        if (change.cut) {
+            return false;
+        }
+    }
+
+    vector<size_t> levels(chunks);
+    vector<bool> started(chunks);
+    long long level = 0;
+    bool lineStarted = false;
+    for (size_t i = 0; i < chunks; ++i) {
+        levels[i] = size_t(level);
+        started[i] = lineStarted;
+        level = max(level + changes[i].add, changes[i].floor);
+        lineStarted = lineStarted || changes[i].writes;
+    }
+
+    vector<string> outputs(chunks);
+    vector<bool> done(chunks, false);
+    mutex lock;
+    condition_variable finished;
+    nextChunk = 0;
+
+    auto format = [&]() {
+        for (size_t i = nextChunk++; i < chunks; i = nextChunk++) {
+            {
+                OutputBuffer buffer(outputs[i]);
+                XmlFormatter formatter(buffer, options);
+                formatter.resume(levels[i], started[i]);
+                XmlTokenizer tokenizer(range(i));
+                XmlToken token;
+                while (tokenizer.next(token)) {
+                    formatter.consume(token);
+                }
+                if (i + 1 == chunks) {
+                    formatter.finish();
+                }
+            }
+            lock_guard<mutex> guard(lock);
+            done[i] = true;
+            finished.notify_one();
+        }
+    };
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back(format);
+    }
+
+    for (size_t i = 0; i < chunks; ++i) {
+        {
+            unique_lock<mutex> guard(lock);
+            finished.wait(guard, [&]() { return done[i]; });
+        }
+        output.write(outputs[i]);
+        string().swap(outputs[i]);
+    }
+    for (thread& t : pool) {
+        t.join();
+    }
+    return true;
+}
+
+bool FormattingFunction(string_view input, OutputBuffer& output, const FormatOptions& options) {
+    if (options.threads > 1 && input.size() >= MIN_PARALLEL_FORMAT_SIZE &&
+        formatParallel(input, output, options)) {
+        return output.flush();
+    }
+
+    XmlFormatter formatter(output, options);
+    XmlTokenizer tokenizer(input);
+    XmlToken token;
+
+    while (tokenizer.next(token)) {
+        formatter.consume(token);
+    }
+    formatter.finish();
+    return output.flush();
+}
+
+void FormattingStream(istream& in, ostream& out, const FormatOptions& options) {
+    OutputBuffer output(out, XML_STREAM_CHUNK_SIZE);
+    XmlFormatter formatter(output, options);
+    XmlStreamTokenizer tokenizer(in);
+    XmlToken token;
+
+    while (tokenizer.next(token)) {
+        formatter.consume(token);
+    }
+    formatter.finish();
+    output.flush();
+}
@@ -1,13 +1,59 @@
-#ifndef FORMATTING_H
-#define FORMATTING_H
-
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <cctype>
-#include <string>  // Include string header
-
-using namespace std;  // Add this to use standard library types and functions without std::
-
-string FormattingFunction(const string& input) ;
-#endif
+#ifndef FORMATTING_H
+#define FORMATTING_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <string>  // Include string header
+#include <string_view>
+
+#include "OutputBuffer.h"
+#include "XmlTokenizer.h"
+
+using namespace std;  // Add this to use standard library types and functions without std::
+
+// Layout of formatted output: every nesting level is indented by
+// indentWidth copies of indentChar, and every line ends with newline
+struct FormatOptions {
+    unsigned indentWidth = 4;
+    char indentChar = ' ';
+    string newline = "\n";
+    unsigned threads = 1; // ranges of the document formatted at once
+};
+
+// Writes the formatted form of each token to output
+class XmlFormatter {
+public:
+    explicit XmlFormatter(OutputBuffer& output, const FormatOptions& options = FormatOptions());
+    void consume(const XmlToken& token);
+    // Ends the last line
+    void finish();
+    // Continues a document at level, after lines written elsewhere if
+    // lineStarted, so that ranges can be formatted separately
+    void resume(size_t level, bool lineStarted);
+
+private:
+    void writeLine(string_view text);
+
+    OutputBuffer& output;
+    // The line ending followed by indentation for 64 levels. A line starts
+    // with one copy from here that ends the previous line and indents it.
+    string indentSlab;
+    size_t newlineSize;
+    size_t lineBreak; // newlineSize once a line has been written, 0 before
+    size_t indentWidth;
+    size_t indentationLevel;
+};
+
+string FormattingFunction(string_view input, const FormatOptions& options = FormatOptions());
+// Appends the formatted document to output, so a caller can reuse its buffer
+void FormattingFunction(string_view input, string& output, const FormatOptions& options = FormatOptions());
+// Writes the formatted document through output, returns false if a write
+// failed. With options.threads above one, large documents are formatted
+// in ranges on that many threads; the output is the same.
+bool FormattingFunction(string_view input, OutputBuffer& output, const FormatOptions& options = FormatOptions());
+
+// Formats a document chunk by chunk, writing output as it is produced
+void FormattingStream(istream& in, ostream& out, const FormatOptions& options = FormatOptions());
+#endif
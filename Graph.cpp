@@ -3,6 +3,10 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <string_view>
+
+#include "MappedFile.h"
+#include "XmlDocument.h"
 
 using namespace std;
 
@@ -107,85 +111,53 @@ public:
 
     void parseXML(string filename)
     {
-        ifstream file(filename);
-        if (!file.is_open())
+        MappedFile file;
+        if (!file.open(filename))
         {
             cout << "Failed to open file.\n";
             return;
         }
+        XmlDocument document(file.view());
+        buildFromDocument(document);
+    }
 
-        string line;
-        string currentId, currentName;
-        vector<string> currentPosts;
-        vector<string> currentFollowers;
-        bool readingPosts = false, readingFollowers = false, readingID = false; // flags to indicate start of nested tag
+    // Adds every <user> under the document root, then the follower edges
+    void buildFromDocument(const XmlDocument &document)
+    {
+        uint32_t root = document.root();
+        if (root == XML_NO_NODE)
+            return;
 
-        while (getline(file, line))
+        for (uint32_t userNode = document.node(root).firstChild; userNode != XML_NO_NODE; userNode = document.node(userNode).nextSibling)
         {
-            if (line.empty())
+            if (document.node(userNode).name != "user")
                 continue;
 
-            if (line.find("<user>") != string::npos)
-            {
-                currentPosts.clear();
-                currentFollowers.clear();
-                readingID = true;
-            }
+            User newUser;
+            newUser.id = string(document.childText(userNode, "id"));
+            newUser.name = string(document.childText(userNode, "name"));
 
-            if (readingID && line.find("<id>") != string::npos)
-            {
-                currentId = line.substr(line.find("<id>") + 4, line.find("</id>") - line.find("<id>") - 4);
-                readingID = false;
-            }
-            if (line.find("</id>") != string::npos)
+            uint32_t posts = document.child(userNode, "posts");
+            for (uint32_t post = posts == XML_NO_NODE ? XML_NO_NODE : document.node(posts).firstChild; post != XML_NO_NODE; post = document.node(post).nextSibling)
             {
-                readingID = false;
-            }
-
-            if (line.find("<name>") != string::npos)
-            {
-                currentName = line.substr(line.find("<name>") + 6, line.find("</name>") - line.find("<name>") - 6);
-            }
-
-            if (line.find("<posts>") != string::npos)
-            {
-                readingPosts = true;
-            }
-
-            if (readingPosts && line.find("<post>") != string::npos)
-            {
-                string post = line.substr(line.find("<post>") + 6, line.find("</post>") - line.find("<post>") - 6);
-                currentPosts.push_back(post);
-            }
-
-            if (line.find("</posts>") != string::npos)
-            {
-                readingPosts = false;
-            }
-
-            if (line.find("<followers>") != string::npos)
-            {
-                readingFollowers = true;
-            }
-
-            if (readingFollowers && line.find("<id>") != string::npos)
-            {
-                string followerId = line.substr(line.find("<id>") + 4, line.find("</id>") - line.find("<id>") - 4);
-                currentFollowers.push_back(followerId);
+                if (document.node(post).name != "post")
+                    continue;
+                string_view body = document.childText(post, "body");
+                string_view text = body.empty() ? document.node(post).text : body;
+                if (!text.empty())
+                    newUser.posts.push_back(string(text));
             }
 
-            if (line.find("</followers>") != string::npos)
+            uint32_t followers = document.child(userNode, "followers");
+            for (uint32_t follower = followers == XML_NO_NODE ? XML_NO_NODE : document.node(followers).firstChild; follower != XML_NO_NODE; follower = document.node(follower).nextSibling)
             {
-                readingFollowers = false;
+                string_view followerId = document.childText(follower, "id");
+                if (!followerId.empty())
+                    newUser.Followers_id.push_back(string(followerId));
             }
 
-            if (line.find("</user>") != string::npos)
-            {
-                User newUser = {currentId, currentName, currentPosts, currentFollowers};
-                AddVertex(newUser);
-            }
+            AddVertex(newUser);
         }
-        file.close();
         addEdgesBetweenUsers();
     }
 
@@ -0,0 +1,257 @@
+#include "IncrementalVerifier.h"
+#include "XmlTokenizer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+IncrementalVerifier::IncrementalVerifier(string_view document, size_t chunkSize)
+    : chunkSize(max<size_t>(chunkSize, 1)), leafBase(1)
+{
+    splitRegion(document, true, chunks);
+
+    vector<TagBalanceSummary> leaves;
+    vector<LineSummary> leafLines;
+    for (const string &chunk : chunks)
+    {
+        leaves.push_back(summarizeTags(chunk, tags));
+        leafLines.push_back(summarizeLines(chunk));
+    }
+    rebuildTree(leaves, leafLines);
+}
+
+IncrementalVerifier::LineSummary IncrementalVerifier::summarizeLines(string_view text)
+{
+    LineSummary summary;
+    summary.newlines = countNewlines(text);
+    size_t last = text.rfind('\n');
+    summary.tail = last == string_view::npos ? text.size() : text.size() - last - 1;
+    return summary;
+}
+
+void IncrementalVerifier::mergeLines(LineSummary &left, const LineSummary &right)
+{
+    left.tail = right.newlines ? right.tail : left.tail + right.tail;
+    left.newlines += right.newlines;
+}
+
+bool IncrementalVerifier::splitRegion(string_view region, bool atEnd, vector<string> &pieces)
+{
+    vector<string> result;
+    size_t pieceStart = 0, pos = 0;
+    XmlToken token;
+
+    while (scanXmlToken(region, pos, atEnd, token))
+    {
+        // Only markup starts a new chunk, so no tag or comment is ever split
+        if (token.type != XmlTokenType::Text && token.offset - pieceStart >= chunkSize)
+        {
+            result.emplace_back(region.substr(pieceStart, token.offset - pieceStart));
+            pieceStart = token.offset;
+        }
+    }
+    if (pos < region.size() && region[pos] == '<')
+        return false;
+
+    if (pieceStart < region.size() || result.empty())
+        result.emplace_back(region.substr(pieceStart));
+    pieces.swap(result);
+    return true;
+}
+
+void IncrementalVerifier::rebuildTree(vector<TagBalanceSummary> &leaves, vector<LineSummary> &leafLines)
+{
+    leafBase = 1;
+    while (leafBase < leaves.size())
+        leafBase *= 2;
+
+    tree.assign(leafBase * 2, TagBalanceSummary());
+    lines.assign(leafBase * 2, LineSummary());
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        swap(tree[leafBase + i], leaves[i]);
+        lines[leafBase + i] = leafLines[i];
+    }
+    for (size_t node = leafBase - 1; node >= 1; --node)
+        mergeChildren(node);
+}
+
+void IncrementalVerifier::mergeChildren(size_t node)
+{
+    // Only the nesting part goes up: the per-name lists stay in the leaves
+    const TagBalanceSummary &left = tree[2 * node];
+    TagBalanceSummary &summary = tree[node];
+    summary.length = left.length;
+    summary.cutToken = left.cutToken;
+    summary.nestingBroken = left.nestingBroken;
+    summary.nestingDefect = left.nestingDefect;
+    summary.leadingCloses = left.leadingCloses;
+    summary.trailingOpens = left.trailingOpens;
+    mergeTagNesting(summary, tree[2 * node + 1]);
+
+    lines[node] = lines[2 * node];
+    mergeLines(lines[node], lines[2 * node + 1]);
+}
+
+void IncrementalVerifier::updateLeaf(size_t index)
+{
+    size_t node = leafBase + index;
+    tree[node] = summarizeTags(chunks[index], tags);
+    lines[node] = summarizeLines(chunks[index]);
+    for (node /= 2; node >= 1; node /= 2)
+        mergeChildren(node);
+}
+
+size_t IncrementalVerifier::chunkAt(size_t offset) const
+{
+    if (offset >= tree[1].length)
+        return chunks.size() - 1;
+
+    size_t node = 1;
+    while (node < leafBase)
+    {
+        if (offset < tree[2 * node].length)
+        {
+            node = 2 * node;
+        }
+        else
+        {
+            offset -= tree[2 * node].length;
+            node = 2 * node + 1;
+        }
+    }
+    return node - leafBase;
+}
+
+size_t IncrementalVerifier::chunkStart(size_t index) const
+{
+    size_t start = 0;
+    for (size_t node = leafBase + index; node > 1; node /= 2)
+    {
+        if (node % 2 == 1)
+            start += tree[node - 1].length;
+    }
+    return start;
+}
+
+void IncrementalVerifier::applyEdit(size_t offset, size_t length, string_view replacement)
+{
+    offset = min(offset, size());
+    length = min(length, size() - offset);
+
+    // Neighbouring chunks are included so that an edit at a chunk boundary
+    // is re-tokenized together with the markup on both sides
+    size_t first = chunkAt(offset);
+    size_t last = chunkAt(offset + length);
+    if (first > 0)
+        --first;
+    if (last + 1 < chunks.size())
+        ++last;
+
+    size_t regionStart = chunkStart(first);
+    string region;
+    for (size_t i = first; i <= last; ++i)
+        region += chunks[i];
+    region.replace(offset - regionStart, length, replacement.data(), replacement.size());
+
+    // An edit that opens a comment or tag may swallow the chunks after it.
+    // The region doubles each time, so a long swallow is re-scanned a few
+    // times rather than once per chunk.
+    vector<string> pieces;
+    while (!splitRegion(region, last + 1 == chunks.size(), pieces))
+    {
+        size_t grow = last - first + 1;
+        for (size_t i = 0; i < grow && last + 1 < chunks.size(); ++i)
+            region += chunks[++last];
+    }
+
+    size_t oldCount = last - first + 1;
+    if (pieces.size() == oldCount)
+    {
+        for (size_t i = 0; i < pieces.size(); ++i)
+        {
+            chunks[first + i].swap(pieces[i]);
+            updateLeaf(first + i);
+        }
+        return;
+    }
+
+    // The chunk count changed: only the new pieces are scanned, the other
+    // leaf summaries are reused and the levels above them re-merged
+    vector<TagBalanceSummary> leaves;
+    vector<LineSummary> leafLines;
+    leaves.reserve(chunks.size() - oldCount + pieces.size());
+    leafLines.reserve(leaves.capacity());
+    for (size_t i = 0; i < first; ++i)
+    {
+        leaves.push_back(move(tree[leafBase + i]));
+        leafLines.push_back(lines[leafBase + i]);
+    }
+    for (const string &piece : pieces)
+    {
+        leaves.push_back(summarizeTags(piece, tags));
+        leafLines.push_back(summarizeLines(piece));
+    }
+    for (size_t i = last + 1; i < chunks.size(); ++i)
+    {
+        leaves.push_back(move(tree[leafBase + i]));
+        leafLines.push_back(lines[leafBase + i]);
+    }
+
+    chunks.erase(chunks.begin() + first, chunks.begin() + last + 1);
+    chunks.insert(chunks.begin() + first, make_move_iterator(pieces.begin()), make_move_iterator(pieces.end()));
+    rebuildTree(leaves, leafLines);
+}
+
+TextPosition IncrementalVerifier::position(size_t offset) const
+{
+    offset = min(offset, size());
+
+    // Lines of every chunk left of the path, then of the chunk's prefix
+    LineSummary before;
+    size_t node = 1;
+    while (node < leafBase)
+    {
+        // The end of the document belongs to the last chunk, not the padding
+        if (offset < tree[2 * node].length || tree[2 * node + 1].length == 0)
+        {
+            node = 2 * node;
+        }
+        else
+        {
+            offset -= tree[2 * node].length;
+            mergeLines(before, lines[2 * node]);
+            node = 2 * node + 1;
+        }
+    }
+    string_view chunk = chunks[node - leafBase];
+    mergeLines(before, summarizeLines(chunk.substr(0, offset)));
+    return {before.newlines + 1, before.tail + 1};
+}
+
+vector<size_t> IncrementalVerifier::mismatches() const
+{
+    TagBalanceSummary whole = tree[1];
+    matchTagNames(&tree[leafBase], chunks.size(), whole);
+    return mismatchPositions(whole);
+}
+
+vector<TagError> IncrementalVerifier::errors() const
+{
+    vector<TagError> result;
+    for (size_t offset : mismatches())
+    {
+        TextPosition where = position(offset);
+        result.push_back({offset, where.line, where.column});
+    }
+    return result;
+}
+
+string IncrementalVerifier::text() const
+{
+    string result;
+    result.reserve(size());
+    for (const string &chunk : chunks)
+        result += chunk;
+    return result;
+}
@@ -0,0 +1,74 @@
+#ifndef INCREMENTAL_VERIFIER_H
+#define INCREMENTAL_VERIFIER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LineIndex.h"
+#include "TagBalance.h"
+#include "TagInterner.h"
+
+using namespace std;
+
+// Keeps a document split into chunks that end on token boundaries, with a
+// balanced tree of tag-balance summaries over them. An edit re-scans only
+// the chunks it touches and re-merges the summaries above them, so the
+// validity of a large document stays current after small edits. Inner
+// nodes keep only lengths and the strict-nesting leftovers at their ends,
+// so an edit costs the same however many defects the document has. The
+// per-name lists stay in the leaves and are matched across them when
+// mismatches or errors are asked for, in time linear in the chunks and
+// the tags left unmatched inside them.
+class IncrementalVerifier
+{
+public:
+    explicit IncrementalVerifier(string_view document, size_t chunkSize = 1 << 16);
+
+    // Replaces length bytes at offset with replacement
+    void applyEdit(size_t offset, size_t length, string_view replacement);
+
+    bool isValid() const { return isBalanced(tree[1]); }
+    // Offsets of the unmatched tags, sorted, as verify reports them
+    vector<size_t> mismatches() const;
+    // The same tags with their lines and columns
+    vector<TagError> errors() const;
+    TextPosition position(size_t offset) const;
+
+    size_t size() const { return tree[1].length; }
+    size_t chunkCount() const { return chunks.size(); }
+    string text() const;
+
+private:
+    // Newlines in a range and the bytes after the last of them (the whole
+    // range if it has none), so ranges merge into line and column counts
+    struct LineSummary
+    {
+        size_t newlines = 0;
+        size_t tail = 0;
+    };
+
+    static LineSummary summarizeLines(string_view text);
+    static void mergeLines(LineSummary &left, const LineSummary &right);
+
+    // Splits region at token starts into chunks of about chunkSize bytes.
+    // Returns false if region ends inside markup and atEnd is false.
+    bool splitRegion(string_view region, bool atEnd, vector<string> &pieces);
+    void rebuildTree(vector<TagBalanceSummary> &leaves, vector<LineSummary> &leafLines);
+    void mergeChildren(size_t node);
+    void updateLeaf(size_t index);
+    size_t chunkAt(size_t offset) const;
+    size_t chunkStart(size_t index) const;
+
+    size_t chunkSize;
+    TagInterner tags;
+    vector<string> chunks;
+    size_t leafBase;                // index of the first leaf in tree
+    // tree[1] is the root, children of i at 2i and 2i+1; only leaves hold
+    // per-name lists
+    vector<TagBalanceSummary> tree;
+    vector<LineSummary> lines;      // same layout as tree
+};
+
+#endif
@@ -0,0 +1,508 @@
+#include "JsonEscape.h"
+#include "StructuralScanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef XML_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+const size_t JSON_ESCAPE_WINDOW = 32;
+
+// What one 32-byte window holds (bit i = byte i)
+struct EscapeWindow
+{
+    uint32_t special;  // '"', '\\', control characters and, when decoding, '&'
+    uint32_t nonAscii; // bytes from 0x80
+    bool invalid;      // the window may hold invalid UTF-8
+};
+
+static inline bool isSpecial(uint8_t c, bool decodeEntities)
+{
+    return c < 0x20 || c == '"' || c == '\\' || (decodeEntities && c == '&');
+}
+
+static EscapeWindow classifyScalar(const char *window, bool decodeEntities)
+{
+    EscapeWindow result{0, 0, false};
+    for (size_t i = 0; i < JSON_ESCAPE_WINDOW; ++i)
+    {
+        uint8_t c = static_cast<uint8_t>(window[i]);
+        if (isSpecial(c, decodeEntities))
+            result.special |= uint32_t(1) << i;
+        if (c >= 0x80)
+            result.nonAscii |= uint32_t(1) << i;
+    }
+    // Checked by the caller one sequence at a time
+    result.invalid = result.nonAscii != 0;
+    return result;
+}
+
+#ifdef XML_SIMD_X86
+
+__attribute__((target("sse2"))) static EscapeWindow classifySse2(const char *window, bool decodeEntities)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ampersand = _mm_set1_epi8(decodeEntities ? '&' : '"');
+    const __m128i lastControl = _mm_set1_epi8(0x1F);
+
+    EscapeWindow result{0, 0, false};
+    for (int part = 0; part < 2; ++part)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(window + part * 16));
+        // Unsigned c <= 0x1F, as max(c, 0x1F) == 0x1F
+        __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, lastControl), lastControl);
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(chunk, ampersand), control));
+        result.special |= uint32_t(uint16_t(_mm_movemask_epi8(special))) << (part * 16);
+        result.nonAscii |= uint32_t(uint16_t(_mm_movemask_epi8(chunk))) << (part * 16);
+    }
+    result.invalid = result.nonAscii != 0;
+    return result;
+}
+
+// Lookup-table UTF-8 validation. Each byte is checked against the one to
+// three bytes before it: the high and low nibble of the previous byte and
+// the high nibble of this one each index a table of the errors they allow,
+// and an error is left wherever all three agree. The window starts on a
+// sequence boundary, so the bytes before it count as ASCII; a sequence cut
+// by the end of the window is not an error here.
+const uint8_t UTF8_TOO_SHORT = 1 << 0;  // lead byte not followed by a continuation
+const uint8_t UTF8_TOO_LONG = 1 << 1;   // continuation after ASCII
+const uint8_t UTF8_OVERLONG_3 = 1 << 2; // E0 followed by 80..9F
+const uint8_t UTF8_TOO_LARGE = 1 << 3;  // above U+10FFFF
+const uint8_t UTF8_SURROGATE = 1 << 4;  // ED followed by A0..BF
+const uint8_t UTF8_OVERLONG_2 = 1 << 5; // C0 or C1
+const uint8_t UTF8_TOO_LARGE_1000 = 1 << 6;
+const uint8_t UTF8_OVERLONG_4 = 1 << 6; // F0 followed by 80..8F
+const uint8_t UTF8_TWO_CONTS = 1 << 7;  // continuation after continuation
+const uint8_t UTF8_CARRY = UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS;
+
+alignas(16) static const uint8_t UTF8_BYTE_1_HIGH[16] = {
+    // 0_______: ASCII
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    // 10______: continuation
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    // 1100____, 1101____: two-byte lead
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    // 1110____: three-byte lead
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    // 1111____: four-byte lead
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4};
+
+alignas(16) static const uint8_t UTF8_BYTE_1_LOW[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, // ____0000
+    UTF8_CARRY | UTF8_OVERLONG_2,                                     // ____0001
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE, // ____0100
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, // ____1101
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000};
+
+alignas(16) static const uint8_t UTF8_BYTE_2_HIGH[16] = {
+    // 0_______: ASCII
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    // 1000____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    // 1001____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    // 101_____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+    // 11______: lead
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT};
+
+// input shifted right by count bytes across the lane boundary, zeros in front
+template <int count>
+__attribute__((target("avx2"))) static inline __m256i previousBytes(__m256i input)
+{
+    __m256i before = _mm256_permute2x128_si256(_mm256_setzero_si256(), input, 0x21);
+    return _mm256_alignr_epi8(input, before, 16 - count);
+}
+
+__attribute__((target("avx2"))) static inline __m256i nibbleLookup(const uint8_t *table, __m256i nibbles)
+{
+    __m256i lanes = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+    return _mm256_shuffle_epi8(lanes, nibbles);
+}
+
+__attribute__((target("avx2"))) static bool hasUtf8ErrorAvx2(__m256i input)
+{
+    const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+    __m256i previous1 = previousBytes<1>(input);
+    __m256i errors = _mm256_and_si256(
+        _mm256_and_si256(nibbleLookup(UTF8_BYTE_1_HIGH, _mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibble)),
+                         nibbleLookup(UTF8_BYTE_1_LOW, _mm256_and_si256(previous1, lowNibble))),
+        nibbleLookup(UTF8_BYTE_2_HIGH, _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble)));
+
+    // Third and fourth bytes of a sequence are the continuations after a
+    // continuation that UTF8_TWO_CONTS flags; they cancel out here
+    __m256i third = _mm256_subs_epu8(previousBytes<2>(input), _mm256_set1_epi8(char(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(previousBytes<3>(input), _mm256_set1_epi8(char(0xF0 - 0x80)));
+    __m256i expected = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+    errors = _mm256_xor_si256(errors, expected);
+    return !_mm256_testz_si256(errors, errors);
+}
+
+__attribute__((target("avx2"))) static EscapeWindow classifyAvx2(const char *window, bool decodeEntities)
+{
+    const __m256i lastControl = _mm256_set1_epi8(0x1F);
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(window));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(chunk, lastControl), lastControl);
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\\'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(decodeEntities ? '&' : '"')), control));
+
+    EscapeWindow result;
+    result.special = uint32_t(_mm256_movemask_epi8(special));
+    result.nonAscii = uint32_t(_mm256_movemask_epi8(chunk));
+    result.invalid = result.nonAscii != 0 && hasUtf8ErrorAvx2(chunk);
+    return result;
+}
+
+#endif
+
+struct EscapeDispatch
+{
+    EscapeWindow (*classify)(const char *, bool);
+    const char *name;
+};
+
+static EscapeDispatch selectEscapeKernel()
+{
+    switch (simdLevel())
+    {
+#ifdef XML_SIMD_X86
+    case SimdLevel::Avx2:
+        return {classifyAvx2, "avx2"};
+    case SimdLevel::Sse2:
+        return {classifySse2, "sse2"};
+#endif
+    default:
+        return {classifyScalar, "scalar"};
+    }
+}
+
+// Not const, so check/xml_selfcheck.cpp can run each kernel in turn
+static EscapeDispatch &escapeDispatch()
+{
+    static EscapeDispatch dispatch = selectEscapeKernel();
+    return dispatch;
+}
+
+const char *jsonEscapeKernelName()
+{
+    return escapeDispatch().name;
+}
+
+// Length of the valid UTF-8 sequence at p, or 0 with invalidLength set to
+// the bytes that stand for one U+FFFD (the longest valid-looking start)
+static size_t utf8SequenceLength(const uint8_t *p, size_t left, size_t &invalidLength)
+{
+    uint8_t lead = p[0];
+    if (lead < 0x80)
+        return 1;
+
+    size_t length;
+    uint8_t low = 0x80, high = 0xBF; // range of the second byte
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        length = 3;
+        low = lead == 0xE0 ? 0xA0 : low;  // overlong
+        high = lead == 0xED ? 0x9F : high; // surrogates
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        low = lead == 0xF0 ? 0x90 : low;   // overlong
+        high = lead == 0xF4 ? 0x8F : high; // above U+10FFFF
+    }
+    else
+    {
+        invalidLength = 1;
+        return 0;
+    }
+
+    size_t i = 1;
+    for (; i < length && i < left; ++i)
+    {
+        uint8_t next = p[i];
+        if (i == 1 ? (next < low || next > high) : (next & 0xC0) != 0x80)
+            break;
+    }
+    if (i == length)
+        return length;
+    invalidLength = i;
+    return 0;
+}
+
+// Length of the unit at p when it is copied as it is, 0 when it needs work
+static inline size_t cleanLength(const uint8_t *p, size_t left, bool decodeEntities)
+{
+    if (p[0] < 0x80)
+        return isSpecial(p[0], decodeEntities) ? 0 : 1;
+    size_t invalidLength;
+    return utf8SequenceLength(p, left, invalidLength);
+}
+
+// Offset in a valid window after its last complete sequence
+static size_t lastBoundary(const uint8_t *window)
+{
+    for (size_t back = 1; back <= 3; ++back)
+    {
+        uint8_t c = window[JSON_ESCAPE_WINDOW - back];
+        if (c < 0x80)
+            return JSON_ESCAPE_WINDOW;
+        if ((c & 0xC0) == 0xC0)
+        {
+            size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+            return length > back ? JSON_ESCAPE_WINDOW - back : JSON_ESCAPE_WINDOW;
+        }
+    }
+    return JSON_ESCAPE_WINDOW;
+}
+
+// First offset from pos, on a sequence boundary, where the text needs work
+static size_t skipClean(const char *text, size_t pos, size_t size, bool decodeEntities)
+{
+    const EscapeDispatch &kernel = escapeDispatch();
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(text);
+
+    while (pos < size)
+    {
+        size_t length = min(JSON_ESCAPE_WINDOW, size - pos);
+        const char *window = text + pos;
+        // Short tails are padded with spaces, which need no work and end any sequence
+        char padded[JSON_ESCAPE_WINDOW];
+        if (length < JSON_ESCAPE_WINDOW)
+        {
+            memcpy(padded, window, length);
+            memset(padded + length, ' ', JSON_ESCAPE_WINDOW - length);
+            window = padded;
+        }
+
+        EscapeWindow classes = kernel.classify(window, decodeEntities);
+        if ((classes.special | classes.nonAscii) == 0)
+        {
+            pos += length;
+            continue;
+        }
+        if (!classes.invalid)
+        {
+            // Valid UTF-8 up to here, so the special byte starts a unit
+            if (classes.special)
+                return pos + lowestSetBit(classes.special);
+            pos += length < JSON_ESCAPE_WINDOW ? length : lastBoundary(data + pos);
+            continue;
+        }
+
+        // The window has an invalid sequence somewhere: walk it one unit at a time
+        size_t end = pos + length;
+        while (pos < end)
+        {
+            size_t unit = cleanLength(data + pos, size - pos, decodeEntities);
+            if (unit == 0)
+                return pos;
+            pos += unit;
+        }
+    }
+    return pos;
+}
+
+size_t jsonCleanPrefix(string_view text, bool decodeEntities)
+{
+    return skipClean(text.data(), 0, text.size(), decodeEntities);
+}
+
+static inline char *writeAscii(char c, char *out)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    switch (c)
+    {
+    case '"': *out++ = '\\'; *out++ = '"'; return out;
+    case '\\': *out++ = '\\'; *out++ = '\\'; return out;
+    case '\b': *out++ = '\\'; *out++ = 'b'; return out;
+    case '\f': *out++ = '\\'; *out++ = 'f'; return out;
+    case '\n': *out++ = '\\'; *out++ = 'n'; return out;
+    case '\r': *out++ = '\\'; *out++ = 'r'; return out;
+    case '\t': *out++ = '\\'; *out++ = 't'; return out;
+    default:
+        break;
+    }
+    if (static_cast<unsigned char>(c) < 0x20)
+    {
+        memcpy(out, "\\u00", 4);
+        out[4] = hexDigits[(c >> 4) & 0xF];
+        out[5] = hexDigits[c & 0xF];
+        return out + 6;
+    }
+    *out++ = c;
+    return out;
+}
+
+static char *writeCodePoint(uint32_t codePoint, char *out, bool escape)
+{
+    // NUL, surrogates and values past U+10FFFF have no place in the text
+    if (codePoint == 0 || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF)
+        codePoint = 0xFFFD;
+    if (codePoint < 0x80)
+    {
+        if (escape)
+            return writeAscii(char(codePoint), out);
+        *out++ = char(codePoint);
+        return out;
+    }
+    if (codePoint < 0x800)
+    {
+        *out++ = char(0xC0 | (codePoint >> 6));
+    }
+    else if (codePoint < 0x10000)
+    {
+        *out++ = char(0xE0 | (codePoint >> 12));
+        *out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+    }
+    else
+    {
+        *out++ = char(0xF0 | (codePoint >> 18));
+        *out++ = char(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = char(0x80 | ((codePoint >> 6) & 0x3F));
+    }
+    *out++ = char(0x80 | (codePoint & 0x3F));
+    return out;
+}
+
+// Length of the entity or character reference at p ('&'), 0 if it is none
+static size_t decodeEntity(const char *p, size_t left, uint32_t &codePoint)
+{
+    static const struct
+    {
+        const char *text;
+        size_t length;
+        char value;
+    } named[] = {{"&amp;", 5, '&'}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&quot;", 6, '"'}, {"&apos;", 6, '\''}};
+
+    for (const auto &entity : named)
+    {
+        if (left >= entity.length && memcmp(p, entity.text, entity.length) == 0)
+        {
+            codePoint = uint32_t(entity.value);
+            return entity.length;
+        }
+    }
+
+    if (left < 4 || p[1] != '#')
+        return 0;
+    bool hex = p[2] == 'x' || p[2] == 'X';
+    size_t i = hex ? 3 : 2;
+    size_t digits = 0;
+    uint32_t value = 0;
+    for (; i < left && digits <= 8; ++i, ++digits)
+    {
+        char c = p[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9')
+            digit = uint32_t(c - '0');
+        else if (hex && c >= 'a' && c <= 'f')
+            digit = uint32_t(c - 'a' + 10);
+        else if (hex && c >= 'A' && c <= 'F')
+            digit = uint32_t(c - 'A' + 10);
+        else
+            break;
+        // Saturates, so an overlong reference ends up above U+10FFFF
+        value = min<uint32_t>(value * (hex ? 16 : 10) + digit, 0x110000);
+    }
+    if (digits == 0 || i >= left || p[i] != ';')
+        return 0;
+    codePoint = value;
+    return i + 1;
+}
+
+// Copies clean runs and rewrites the rest: bad UTF-8 and entities always,
+// and '"', '\\' and control characters when escape is set
+static size_t transcode(string_view text, char *output, bool decodeEntities, bool escape)
+{
+    const char *data = text.data();
+    size_t size = text.size();
+    char *out = output;
+    size_t pos = 0;
+
+    while (true)
+    {
+        size_t clean = skipClean(data, pos, size, decodeEntities);
+        memcpy(out, data + pos, clean - pos);
+        out += clean - pos;
+        pos = clean;
+        if (pos == size)
+            break;
+
+        uint8_t c = static_cast<uint8_t>(data[pos]);
+        if (c >= 0x80)
+        {
+            size_t invalidLength = 1;
+            utf8SequenceLength(reinterpret_cast<const uint8_t *>(data + pos), size - pos, invalidLength);
+            out = writeCodePoint(0xFFFD, out, escape);
+            pos += invalidLength;
+            continue;
+        }
+        uint32_t codePoint;
+        size_t length = c == '&' ? decodeEntity(data + pos, size - pos, codePoint) : 0;
+        if (length > 0)
+        {
+            out = writeCodePoint(codePoint, out, escape);
+            pos += length;
+            continue;
+        }
+        if (escape)
+            out = writeAscii(char(c), out);
+        else
+            *out++ = char(c);
+        ++pos;
+    }
+    return out - output;
+}
+
+size_t escapeJsonString(string_view text, char *output, bool decodeEntities)
+{
+    return transcode(text, output, decodeEntities, true);
+}
+
+size_t decodeXmlText(string_view text, char *output, bool decodeEntities)
+{
+    return transcode(text, output, decodeEntities, false);
+}
+
+void appendJsonString(string &out, string_view value)
+{
+    out += '"';
+    size_t clean = jsonCleanPrefix(value, false);
+    out.append(value.data(), clean);
+    if (clean < value.size())
+    {
+        string_view rest = value.substr(clean);
+        size_t used = out.size();
+        out.resize(used + JSON_ESCAPE_GROWTH * rest.size());
+        out.resize(used + escapeJsonString(rest, &out[used], false));
+    }
+    out += '"';
+}
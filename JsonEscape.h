@@ -0,0 +1,37 @@
+#ifndef JSON_ESCAPE_H
+#define JSON_ESCAPE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Most bytes escapeJsonString writes per input byte: a control character
+// becomes a six-byte \u00XX escape
+const size_t JSON_ESCAPE_GROWTH = 6;
+
+// Length of the longest prefix of text that goes into a JSON string as it
+// is: no '"', '\\' or control character, only valid UTF-8, and no '&' when
+// entities are decoded. Clean text is skipped 32 bytes at a time.
+size_t jsonCleanPrefix(string_view text, bool decodeEntities);
+
+// Writes text as the inside of a JSON string: '"', '\\' and control
+// characters escaped, each invalid UTF-8 sequence replaced by U+FFFD and,
+// when decodeEntities is set, the predefined XML entities and numeric
+// character references decoded. Unknown entities are kept as written.
+// Clean runs are copied untouched. output must hold
+// JSON_ESCAPE_GROWTH * text.size() bytes. Returns the bytes written.
+size_t escapeJsonString(string_view text, char *output, bool decodeEntities);
+
+// Same replacements as escapeJsonString, with '"', '\\' and control
+// characters left as they are, for formats that carry string lengths
+size_t decodeXmlText(string_view text, char *output, bool decodeEntities);
+
+// Appends value to out as a quoted JSON string, entities left alone
+void appendJsonString(string &out, string_view value);
+
+// Name of the selected kernel ("avx2", "sse2" or "scalar")
+const char *jsonEscapeKernelName();
+
+#endif
@@ -0,0 +1,70 @@
+#include "LineIndex.h"
+#include "StructuralScanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Calls visit(blockStart, mask) for every 64-byte block of text
+template <typename Visitor>
+static void scanNewlineBlocks(string_view text, Visitor visit)
+{
+    size_t start = 0;
+    for (; start + STRUCTURAL_BLOCK_SIZE <= text.size(); start += STRUCTURAL_BLOCK_SIZE)
+        visit(start, byteMask(text.data() + start, '\n'));
+
+    if (start < text.size())
+    {
+        char padded[STRUCTURAL_BLOCK_SIZE] = {};
+        memcpy(padded, text.data() + start, text.size() - start);
+        visit(start, byteMask(padded, '\n'));
+    }
+}
+
+void findNewlines(string_view text, vector<size_t> &offsets, size_t base)
+{
+    scanNewlineBlocks(text, [&](size_t start, uint64_t mask) {
+        while (mask)
+        {
+            offsets.push_back(base + start + lowestSetBit(mask));
+            mask &= mask - 1;
+        }
+    });
+}
+
+size_t countNewlines(string_view text)
+{
+    size_t count = 0;
+    scanNewlineBlocks(text, [&](size_t, uint64_t mask) {
+#if defined(__GNUC__)
+        count += __builtin_popcountll(mask);
+#else
+        for (; mask; mask &= mask - 1)
+            ++count;
+#endif
+    });
+    return count;
+}
+
+TextPosition positionOf(string_view text, size_t offset)
+{
+    string_view before = text.substr(0, offset);
+    size_t lineStart = before.rfind('\n');
+    lineStart = lineStart == string_view::npos ? 0 : lineStart + 1;
+    return {countNewlines(before) + 1, before.size() - lineStart + 1};
+}
+
+LineIndex::LineIndex(string_view text)
+{
+    findNewlines(text, newlines);
+}
+
+TextPosition LineIndex::position(size_t offset) const
+{
+    // Newlines before offset give the line, the last of them the column
+    size_t before = lower_bound(newlines.begin(), newlines.end(), offset) - newlines.begin();
+    size_t lineStart = before == 0 ? 0 : newlines[before - 1] + 1;
+    return {before + 1, offset - lineStart + 1};
+}
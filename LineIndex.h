@@ -0,0 +1,42 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// 1-based line and byte column of an offset
+struct TextPosition
+{
+    size_t line;
+    size_t column;
+};
+
+// Appends the offset of every '\n' in text, plus base, to offsets. The
+// input is classified 64 bytes at a time with the widest available SIMD.
+void findNewlines(string_view text, vector<size_t> &offsets, size_t base = 0);
+
+// Number of '\n' bytes in text
+size_t countNewlines(string_view text);
+
+// Position of offset found by counting the newlines before it, for when
+// only a few offsets are needed
+TextPosition positionOf(string_view text, size_t offset);
+
+// Sorted newline offsets of a document, built in one pass, so that an
+// offset maps to its line with a binary search
+class LineIndex
+{
+public:
+    explicit LineIndex(string_view text);
+
+    TextPosition position(size_t offset) const;
+    size_t lineCount() const { return newlines.size() + 1; }
+
+private:
+    vector<size_t> newlines;
+};
+
+#endif
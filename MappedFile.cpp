@@ -0,0 +1,154 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile() : data(nullptr), length(0), opened(false), mapped(false) {}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (mapped)
+        munmap(const_cast<char *>(data), length);
+#endif
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    length = 0;
+    opened = false;
+    mapped = false;
+}
+
+#ifndef _WIN32
+
+bool MappedFile::open(const string &fileName)
+{
+    close();
+
+    if (fileName == "-")
+        return readStream(STDIN_FILENO);
+
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Pipes, FIFOs and character devices cannot be mapped
+    if (!S_ISREG(info.st_mode))
+    {
+        bool ok = readStream(fd);
+        ::close(fd);
+        return ok;
+    }
+
+    length = static_cast<size_t>(info.st_size);
+    if (length == 0)
+    {
+        ::close(fd);
+        opened = true;
+        return true;
+    }
+
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        length = 0;
+        bool ok = readStream(fd);
+        ::close(fd);
+        return ok;
+    }
+    ::close(fd);
+
+    // Input is consumed front to back by every command
+    madvise(address, length, MADV_SEQUENTIAL);
+
+    data = static_cast<const char *>(address);
+    mapped = true;
+    opened = true;
+    return true;
+}
+
+bool MappedFile::readStream(int fd)
+{
+    size_t capacity = 1 << 16;
+    buffer.resize(capacity);
+    size_t used = 0;
+
+    while (true)
+    {
+        if (used == capacity)
+        {
+            capacity *= 2;
+            buffer.resize(capacity);
+        }
+        ssize_t got = ::read(fd, &buffer[used], capacity - used);
+        if (got < 0)
+        {
+            buffer.clear();
+            return false;
+        }
+        if (got == 0)
+            break;
+        used += static_cast<size_t>(got);
+    }
+
+    buffer.resize(used);
+    data = buffer.data();
+    length = used;
+    opened = true;
+    return true;
+}
+
+#else
+
+bool MappedFile::open(const string &fileName)
+{
+    close();
+
+    if (fileName == "-")
+    {
+        buffer.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    }
+    else
+    {
+        ifstream file(fileName, ios::binary);
+        if (!file.is_open())
+            return false;
+        file.seekg(0, ios::end);
+        buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, ios::beg);
+        file.read(&buffer[0], buffer.size());
+    }
+
+    data = buffer.data();
+    length = buffer.size();
+    opened = true;
+    return true;
+}
+
+bool MappedFile::readStream(int)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Read-only view of a whole input file.
+// Regular files are memory-mapped so no heap copy is made; pipes, stdin ("-")
+// and platforms without mmap fall back to reading into an owned buffer.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Opens fileName ("-" means stdin), returns false if it cannot be read
+    bool open(const string &fileName);
+    void close();
+
+    bool isOpen() const { return opened; }
+    size_t size() const { return length; }
+    string_view view() const { return string_view(data, length); }
+
+private:
+    bool readStream(int fd);
+
+    const char *data;
+    size_t length;
+    bool opened;
+    bool mapped;
+    string buffer; // storage used by the read() fallback
+};
+
+#endif
@@ -1,43 +1,111 @@
-using namespace std;  // Add this to use standard library types and functions without std::
-
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <cctype>
-#include <string>  // Include string header
-
-string MinifyingFunction(const string& input) {
-    string output;
-    bool insideTag = false;
-    
-    for (size_t i = 0; i < input.size(); ++i) {
-        char ch = input[i];
-        
-        if (ch == '<') {
-            // Start of a new tag
-            if (!output.empty() && output.back() != '\n') {
-                output += '\n'; // Add a newline before starting a new tag
-            }
-            insideTag = true;
-            output += ch;
-        }
-        else if (ch == '>') {
-            // End of a tag
-            insideTag = false;
-            output += ch;
-            output += '\n'; // Add a newline after closing the tag
-        }
-        else if (insideTag) {
-            // Inside a tag, preserve all characters
-            output += ch;
-        }
-        else {
-            // Outside tags (text content)
-            if (!isspace(static_cast<unsigned char>(ch)) || (output.empty() || output.back() != '\n')) {
-                // Preserve text content but trim excessive whitespace
-                output += ch;
-            }
-        }
-    }
-    return output;
-}
\ No newline at end of file
+using namespace std;  // Add this to use standard library types and functions without std::
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <string>  // Include string header
+
+#include "Minifying.h"
+#include "XmlTokenizer.h"
+
+XmlMinifier::XmlMinifier(SpanWriter& output, const MinifyOptions& options)
+    : output(output), stripComments(options.stripComments) {}
+
+void XmlMinifier::consume(const XmlToken& token) {
+    // A stripped comment leaves its neighbours as if it were not there
+    if (token.type == XmlTokenType::Comment && stripComments) {
+        return;
+    }
+
+    // Space held back from the end of the last text is only needed if
+    // more content follows it in the same element
+    if (pendingSpace && token.type != XmlTokenType::EndTag) {
+        output.write(" ", 1);
+    }
+    pendingSpace = false;
+
+    if (token.type == XmlTokenType::Text) {
+        writeText(token.raw);
+    } else {
+        // Tags, comments, CDATA and declarations are kept exactly as written
+        output.write(token.raw);
+    }
+    previous = token.type;
+}
+
+void XmlMinifier::writeText(string_view raw) {
+    // Whitespace-only text between tags disappears
+    string_view text = trimWhitespace(raw);
+    if (text.empty()) {
+        return;
+    }
+
+    // Whitespace at an edge is dropped where it touches the element's own
+    // tags, and kept as one space next to inline markup, where it
+    // separates words
+    if (text.data() != raw.data() && previous != XmlTokenType::StartTag) {
+        output.write(" ", 1);
+    }
+    pendingSpace = text.data() + text.size() != raw.data() + raw.size();
+
+    // Inside the text, a whitespace run with a line break is layout and
+    // becomes one space; other runs are kept as written
+    size_t start = 0, pos = 0;
+    while (pos < text.size()) {
+        if (!isXmlSpace(text[pos])) {
+            ++pos;
+            continue;
+        }
+        size_t end = pos;
+        bool lineBreak = false;
+        while (end < text.size() && isXmlSpace(text[end])) {
+            lineBreak = lineBreak || text[end] == '\n' || text[end] == '\r';
+            ++end;
+        }
+        if (lineBreak) {
+            output.write(text.substr(start, pos - start));
+            output.write(" ", 1);
+            start = end;
+        }
+        pos = end;
+    }
+    output.write(text.substr(start));
+}
+
+string MinifyingFunction(string_view input, const MinifyOptions& options) {
+    string output;
+    MinifyingFunction(input, output, options);
+    return output;
+}
+
+void MinifyingFunction(string_view input, string& output, const MinifyOptions& options) {
+    OutputBuffer buffer(output);
+    SpanWriter spans(buffer);
+    MinifyingFunction(input, spans, options);
+}
+
+bool MinifyingFunction(string_view input, SpanWriter& output, const MinifyOptions& options) {
+    XmlMinifier minifier(output, options);
+    XmlTokenizer tokenizer(input);
+    XmlToken token;
+
+    while (tokenizer.next(token)) {
+        minifier.consume(token);
+    }
+    return output.flush();
+}
+
+void MinifyingStream(istream& in, ostream& out, const MinifyOptions& options) {
+    // Token views die with the next chunk, so ranges are copied out at once
+    OutputBuffer buffer(out, XML_STREAM_CHUNK_SIZE);
+    SpanWriter output(buffer);
+    XmlMinifier minifier(output, options);
+    XmlStreamTokenizer tokenizer(in);
+    XmlToken token;
+
+    while (tokenizer.next(token)) {
+        minifier.consume(token);
+    }
+    output.flush();
+}
@@ -1,14 +1,52 @@
-#ifndef MINIFYING_H
-#define MINIFYING_H
-
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <cctype>
-#include <string>  // Include string header
-
-using namespace std;  // Add this to use standard library types and functions without std::
-
-string MinifyingFunction(const string& input);
-
-#endif
+#ifndef MINIFYING_H
+#define MINIFYING_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <string>  // Include string header
+#include <string_view>
+
+#include "SpanWriter.h"
+#include "XmlTokenizer.h"
+
+using namespace std;  // Add this to use standard library types and functions without std::
+
+struct MinifyOptions {
+    bool stripComments = false;
+};
+
+// Writes the minified form of each token to output: markup as written,
+// nothing for text that is only whitespace, and text without the layout
+// around it. Whitespace at the edge of a text is dropped next to the
+// element's own tags and becomes one space next to inline markup; runs
+// with a line break inside it become one space, so an indented document
+// ends up on one line. Apart from those spaces every piece is a range of
+// the token, so output receives spans of the input rather than copies.
+class XmlMinifier {
+public:
+    explicit XmlMinifier(SpanWriter& output, const MinifyOptions& options = MinifyOptions());
+    void consume(const XmlToken& token);
+
+private:
+    void writeText(string_view raw);
+
+    SpanWriter& output;
+    bool stripComments;
+    // Nothing before the first token, which is treated like an open tag
+    XmlTokenType previous = XmlTokenType::StartTag;
+    bool pendingSpace = false; // the last text ended in whitespace
+};
+
+string MinifyingFunction(string_view input, const MinifyOptions& options = MinifyOptions());
+// Appends the minified document to output, so a caller can reuse its buffer
+void MinifyingFunction(string_view input, string& output, const MinifyOptions& options = MinifyOptions());
+// Writes the minified document as spans of input, which must stay valid
+// until output is flushed. Returns false if a write failed.
+bool MinifyingFunction(string_view input, SpanWriter& output, const MinifyOptions& options = MinifyOptions());
+
+// Minifies a document chunk by chunk, writing output as it is produced
+void MinifyingStream(istream& in, ostream& out, const MinifyOptions& options = MinifyOptions());
+
+#endif
@@ -0,0 +1,210 @@
+#include "NetworkGenerator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_set>
+
+using namespace std;
+
+// Two-letter syllables, so the syllables of a word never run together ambiguously
+static const char SYLLABLE_CONSONANTS[] = "bcdfghjklmnprstvwxyz";
+static const char SYLLABLE_VOWELS[] = "aeiou";
+static const size_t SYLLABLE_COUNT = 20 * 5;
+
+// Mixes the id into the seed so neighbouring users draw unrelated streams
+static const uint64_t USER_SEED_MULTIPLIER = 0xD1B54A32D192ED03ULL;
+
+enum class NetworkDefect
+{
+    Unclosed,  // the closing tag is left out
+    Unopened,  // the opening tag is left out
+    Misspelled // the closing tag names another element
+};
+
+ZipfSampler::ZipfSampler(size_t n, double exponent) : cumulative(max<size_t>(n, 1))
+{
+    double sum = 0;
+    for (size_t rank = 0; rank < cumulative.size(); ++rank)
+    {
+        sum += 1.0 / pow(double(rank + 1), exponent);
+        cumulative[rank] = sum;
+    }
+    for (double &value : cumulative)
+        value /= sum;
+}
+
+size_t ZipfSampler::sample(SplitMix64 &random) const
+{
+    size_t rank = lower_bound(cumulative.begin(), cumulative.end(), random.unit()) - cumulative.begin();
+    return min(rank, cumulative.size() - 1);
+}
+
+// Word of at least two syllables: index + SYLLABLE_COUNT written in base SYLLABLE_COUNT
+static string syllableWord(size_t index)
+{
+    string word;
+    for (size_t value = index + SYLLABLE_COUNT; value > 0; value /= SYLLABLE_COUNT)
+    {
+        size_t syllable = value % SYLLABLE_COUNT;
+        word += SYLLABLE_VOWELS[syllable % 5];
+        word += SYLLABLE_CONSONANTS[syllable / 5];
+    }
+    reverse(word.begin(), word.end());
+    return word;
+}
+
+NetworkGenerator::NetworkGenerator(const NetworkGeneratorOptions &options)
+    : options(options), wordRanks(max<size_t>(options.vocabulary, 1), 1.0),
+      followerCounts(options.maxFollowers + 1, options.followerExponent)
+{
+    this->options.maxPosts = max(options.minPosts, options.maxPosts);
+    this->options.maxWords = max(max<size_t>(options.minWords, 1), options.maxWords);
+    words.reserve(max<size_t>(options.vocabulary, 1));
+    for (size_t i = 0; i < max<size_t>(options.vocabulary, 1); ++i)
+        words.push_back(syllableWord(i));
+}
+
+// Appends <name>content</name>, or a broken form of it when defect is set
+static void appendElement(string &text, const string &indent, const char *name, const string &content,
+                          const NetworkDefect *defect)
+{
+    text += indent;
+    if (!defect || *defect != NetworkDefect::Unopened)
+    {
+        text += '<';
+        text += name;
+        text += '>';
+    }
+    text += content;
+    if (!defect || *defect != NetworkDefect::Unclosed)
+    {
+        text += "</";
+        text += name;
+        // A swapped pair of letters, which no element of the shape is named
+        if (defect && *defect == NetworkDefect::Misspelled)
+            swap(text[text.size() - 1], text[text.size() - 2]);
+        text += '>';
+    }
+    text += '\n';
+}
+
+void NetworkGenerator::writeUser(size_t id, string &text)
+{
+    SplitMix64 random(options.seed ^ (id * USER_SEED_MULTIPLIER));
+    bool noisy = random.unit() < options.noise;
+    bool broken = random.unit() < options.defects;
+
+    // Noisy users are indented with tabs and carry a comment and attributes
+    string step = noisy ? "\t" : "    ";
+    string in1 = step, in2 = step + step, in3 = in2 + step, in4 = in3 + step, in5 = in4 + step;
+
+    if (noisy)
+        text += in1 + "<!-- user " + to_string(id) + " -->\n";
+    text += noisy ? in1 + "<user kind=\"" + words[wordRanks.sample(random)] + "\" rank='" +
+                        to_string(random.below(100)) + "'>\n"
+                  : in1 + "<user>\n";
+
+    // The defect lands on the id or the name, which every user has once
+    NetworkDefect defect = NetworkDefect(random.below(3));
+    bool brokenId = broken && random.below(2) == 0;
+    appendElement(text, in2, "id", to_string(id), brokenId ? &defect : nullptr);
+
+    string name = syllableWord(random.below(SYLLABLE_COUNT * SYLLABLE_COUNT));
+    name[0] = char(toupper(static_cast<unsigned char>(name[0])));
+    appendElement(text, in2, "name", name + " " + to_string(id), broken && !brokenId ? &defect : nullptr);
+    counts.defects += broken;
+
+    text += in2 + "<posts>\n";
+    size_t posts = options.minPosts + random.below(options.maxPosts - options.minPosts + 1);
+    for (size_t post = 0; post < posts; ++post)
+    {
+        string body;
+        for (size_t word = options.minWords + random.below(options.maxWords - options.minWords + 1); word > 0; --word)
+        {
+            body += words[wordRanks.sample(random)];
+            if (word > 1)
+                body += ' ';
+        }
+
+        // A quarter of the posts are bare text, as in Network.xml
+        if (random.below(4) == 0)
+        {
+            appendElement(text, in3, "post", body, nullptr);
+            continue;
+        }
+        text += in3 + "<post>\n";
+        if (noisy && random.below(2) == 0)
+            body = "<![CDATA[" + body + "]]>";
+        appendElement(text, in4, "body", body, nullptr);
+        text += in4 + "<topics>\n";
+        for (size_t topic = 1 + random.below(3); topic > 0; --topic)
+            appendElement(text, in5, "topic", words[wordRanks.sample(random)], nullptr);
+        text += in4 + "</topics>\n";
+        text += in3 + "</post>\n";
+    }
+    text += in2 + "</posts>\n";
+    counts.posts += posts;
+
+    // Followers come from every id of the document, or from the users
+    // already written when its length decides how many there will be
+    size_t pool = options.targetBytes ? id - 1 : options.users - 1;
+    size_t followers = min(followerCounts.sample(random), pool);
+    unordered_set<size_t> chosen;
+    text += in2 + "<followers>\n";
+    while (chosen.size() < followers)
+    {
+        size_t follower = 1 + random.below(options.targetBytes ? id - 1 : options.users);
+        if (follower == id || !chosen.insert(follower).second)
+            continue;
+        text += in3 + "<follower>\n";
+        appendElement(text, in4, "id", to_string(follower), nullptr);
+        text += in3 + "</follower>\n";
+    }
+    text += in2 + "</followers>\n";
+    counts.follows += followers;
+
+    text += in1 + "</user>\n";
+}
+
+bool NetworkGenerator::write(OutputBuffer &out)
+{
+    counts = NetworkGeneratorStats();
+    size_t start = out.size();
+    string closing = "</" + options.root + ">\n";
+    out.write("<" + options.root + ">\n");
+
+    string user;
+    for (size_t id = 1; options.targetBytes ? out.size() - start + closing.size() < options.targetBytes
+                                            : id <= options.users;
+         ++id)
+    {
+        user.clear();
+        writeUser(id, user);
+        out.write(user);
+        ++counts.users;
+        if (out.failed())
+            return false;
+    }
+
+    out.write(closing);
+    counts.bytes = out.size() - start;
+    return !out.failed();
+}
+
+size_t parseByteSize(const string &text)
+{
+    size_t value = strtoull(text.c_str(), nullptr, 10);
+    switch (text.empty() ? 0 : toupper(static_cast<unsigned char>(text.back())))
+    {
+    case 'K':
+        return value << 10;
+    case 'M':
+        return value << 20;
+    case 'G':
+        return value << 30;
+    default:
+        return value;
+    }
+}
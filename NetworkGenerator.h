@@ -0,0 +1,113 @@
+#ifndef NETWORK_GENERATOR_H
+#define NETWORK_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "OutputBuffer.h"
+
+using namespace std;
+
+// splitmix64: small, fast and good enough for test data
+class SplitMix64
+{
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    // Uniform in [0, limit)
+    size_t below(size_t limit) { return limit ? size_t(next() % limit) : 0; }
+    // Uniform in [0, 1)
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t state;
+};
+
+// Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^exponent
+class ZipfSampler
+{
+public:
+    ZipfSampler(size_t n, double exponent);
+    size_t sample(SplitMix64 &random) const;
+
+private:
+    vector<double> cumulative;
+};
+
+struct NetworkGeneratorOptions
+{
+    uint64_t seed = 1;
+    size_t users = 1000;
+    // When nonzero, users are added until the document reaches this many
+    // bytes, and users is ignored
+    size_t targetBytes = 0;
+    string root = "network";
+
+    size_t minPosts = 0;
+    size_t maxPosts = 4;
+    size_t minWords = 8; // per post body
+    size_t maxWords = 40;
+    size_t vocabulary = 2000; // distinct words, used with Zipf frequencies
+
+    // Follower counts follow a power law: k followers with probability
+    // proportional to 1 / (k + 1)^followerExponent, up to maxFollowers
+    double followerExponent = 2.0;
+    size_t maxFollowers = 1000;
+
+    // Chance per user of formatting noise that keeps the shape: comments,
+    // attributes, CDATA bodies and irregular whitespace
+    double noise = 0;
+    // Chance per user of a defect: an unclosed tag, an unopened tag or a
+    // misspelled closing tag
+    double defects = 0;
+};
+
+struct NetworkGeneratorStats
+{
+    size_t users = 0;
+    size_t posts = 0;
+    size_t follows = 0;
+    size_t defects = 0;
+    size_t bytes = 0;
+};
+
+// Writes social-network documents in the network/user/{id,name,posts,
+// followers} shape that Graph reads. Each user is drawn from its own
+// generator seeded by the seed and its id, so a document is the same on
+// every run and users do not depend on each other. Output is streamed one
+// user at a time, so any size can be written in constant memory.
+class NetworkGenerator
+{
+public:
+    explicit NetworkGenerator(const NetworkGeneratorOptions &options);
+
+    // Writes the document to out, returns false if a write failed
+    bool write(OutputBuffer &out);
+
+    const NetworkGeneratorStats &stats() const { return counts; }
+    // Word of the vocabulary by frequency rank, 0 being the most common
+    const string &word(size_t rank) const { return words[rank]; }
+
+private:
+    void writeUser(size_t id, string &text);
+
+    NetworkGeneratorOptions options;
+    vector<string> words;
+    ZipfSampler wordRanks;
+    ZipfSampler followerCounts;
+    NetworkGeneratorStats counts;
+};
+
+// "16M" -> 16 MiB; K, M and G are powers of 1024
+size_t parseByteSize(const string &text);
+
+#endif
@@ -0,0 +1,172 @@
+#include "OutputBuffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+OutputBuffer::OutputBuffer()
+    : sink(Sink::None), fd(-1), stream(nullptr), text(nullptr),
+      begin(nullptr), cursor(nullptr), limit(nullptr), flushed(0), error(false)
+{
+}
+
+OutputBuffer::OutputBuffer(ostream &stream, size_t capacity) : OutputBuffer()
+{
+    sink = Sink::Stream;
+    this->stream = &stream;
+    block.resize(capacity);
+    begin = cursor = &block[0];
+    limit = begin + block.size();
+}
+
+OutputBuffer::OutputBuffer(string &text) : OutputBuffer()
+{
+    sink = Sink::Text;
+    this->text = &text;
+    size_t used = text.size();
+    begin = &text[0];
+    cursor = limit = begin + used;
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    close();
+}
+
+bool OutputBuffer::openFile(const string &fileName, size_t capacity)
+{
+    close();
+#ifdef _WIN32
+    fd = _open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0)
+        return false;
+
+    sink = Sink::File;
+    error = false;
+    flushed = 0;
+    block.resize(capacity);
+    begin = cursor = &block[0];
+    limit = begin + block.size();
+    return true;
+}
+
+// Makes room for needed more bytes after the cursor in the text sink
+void OutputBuffer::grow(size_t needed)
+{
+    size_t used = cursor - begin;
+    // A reused string keeps its capacity, so it is filled before growing
+    text->resize(max({used + needed, 2 * used, text->capacity(), size_t(4096)}));
+    begin = &(*text)[0];
+    cursor = begin + used;
+    limit = begin + text->size();
+}
+
+bool OutputBuffer::drain(const char *data, size_t size)
+{
+    if (size == 0 || error)
+        return !error;
+
+    if (sink == Sink::Stream)
+    {
+        error = !stream->write(data, size);
+        return !error;
+    }
+
+    while (size > 0)
+    {
+        // Kept below 1 GB per call for platforms that cap a single write
+        unsigned chunk = unsigned(min<size_t>(size, 1 << 30));
+#ifdef _WIN32
+        int count = _write(fd, data, chunk);
+#else
+        ssize_t count = ::write(fd, data, chunk);
+#endif
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+        {
+            error = true;
+            return false;
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+void OutputBuffer::overflow(const char *data, size_t size)
+{
+    if (sink == Sink::Text)
+    {
+        grow(size);
+        memcpy(cursor, data, size);
+        cursor += size;
+        return;
+    }
+    if (sink == Sink::None)
+    {
+        error = true;
+        return;
+    }
+
+    flush();
+    if (size >= block.size())
+    {
+        // Too big to buffer, so it goes straight to the sink
+        drain(data, size);
+        flushed += size;
+        return;
+    }
+    memcpy(cursor, data, size);
+    cursor += size;
+}
+
+bool OutputBuffer::flush()
+{
+    size_t used = cursor - begin;
+    if (sink == Sink::Text)
+    {
+        // The string ends at the last byte written
+        text->resize(used);
+        begin = &(*text)[0];
+        cursor = limit = begin + used;
+        return true;
+    }
+    if (sink == Sink::None)
+        return !error;
+
+    drain(begin, used);
+    flushed += used;
+    cursor = begin;
+    if (sink == Sink::Stream && !error)
+        error = !stream->flush();
+    return !error;
+}
+
+bool OutputBuffer::close()
+{
+    bool ok = flush();
+    if (sink == Sink::File)
+    {
+#ifdef _WIN32
+        ok = _close(fd) == 0 && ok;
+#else
+        ok = ::close(fd) == 0 && ok;
+#endif
+        fd = -1;
+        sink = Sink::None;
+        begin = cursor = limit = nullptr;
+    }
+    return ok;
+}
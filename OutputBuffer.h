@@ -0,0 +1,92 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Size of the block an OutputBuffer fills before handing it to its sink
+const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+// Buffered writer for generated output. Bytes are copied into one large
+// block, which is written out in a single call when it fills up. The sink
+// is a file descriptor, an ostream, or a string that grows in place of
+// being flushed.
+class OutputBuffer
+{
+public:
+    // Unopened buffer, see openFile
+    OutputBuffer();
+    explicit OutputBuffer(ostream &stream, size_t capacity = OUTPUT_BUFFER_SIZE);
+    // Appends to text. The string is grown and used as the block, and is
+    // cut back to the bytes written on flush.
+    explicit OutputBuffer(string &text);
+    // Flushes, and closes a file opened by openFile
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    // Creates or truncates fileName and writes to its descriptor directly
+    bool openFile(const string &fileName, size_t capacity = OUTPUT_BUFFER_SIZE);
+
+    void write(const char *data, size_t size)
+    {
+        if (size > size_t(limit - cursor))
+        {
+            overflow(data, size);
+            return;
+        }
+        memcpy(cursor, data, size);
+        cursor += size;
+    }
+    void write(string_view text) { write(text.data(), text.size()); }
+    void put(char c)
+    {
+        if (cursor == limit)
+        {
+            overflow(&c, 1);
+            return;
+        }
+        *cursor++ = c;
+    }
+
+    // Hands everything buffered to the sink, returns false once a write failed
+    bool flush();
+    // Flushes and closes an opened file
+    bool close();
+
+    bool failed() const { return error; }
+    // Bytes written so far; for a text sink, the length of the string
+    size_t size() const { return flushed + size_t(cursor - begin); }
+
+private:
+    enum class Sink
+    {
+        None,
+        File,
+        Stream,
+        Text,
+    };
+
+    void overflow(const char *data, size_t size);
+    bool drain(const char *data, size_t size);
+    void grow(size_t needed);
+
+    Sink sink;
+    int fd;
+    ostream *stream;
+    string *text;
+    string block; // storage for file and stream sinks
+    char *begin;
+    char *cursor;
+    char *limit;
+    size_t flushed; // bytes already handed to the sink
+    bool error;
+};
+
+#endif
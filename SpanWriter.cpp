@@ -0,0 +1,154 @@
+#include "SpanWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+using namespace std;
+
+// Spans held before a flush; each flush is a few writev calls of IOV_MAX
+const size_t SPAN_WRITER_BATCH = 8 * IOV_MAX;
+const size_t SPAN_STAGING_SIZE = 1 << 16;
+
+SpanWriter::SpanWriter()
+    : copyTo(nullptr), fd(-1), batchSize(SPAN_WRITER_BATCH), staged(0), total(0), error(false)
+{
+}
+
+SpanWriter::SpanWriter(OutputBuffer &output) : SpanWriter()
+{
+    copyTo = &output;
+}
+
+SpanWriter::~SpanWriter()
+{
+    close();
+}
+
+bool SpanWriter::openFile(const string &fileName)
+{
+    close();
+#ifdef _WIN32
+    fd = _open(fileName.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    error = fd < 0;
+    total = 0;
+    spans.reserve(batchSize);
+    staging.resize(SPAN_STAGING_SIZE);
+    return fd >= 0;
+}
+
+void SpanWriter::stage(const char *data, size_t size)
+{
+    if (staged + size > staging.size() || spans.size() == batchSize)
+        flush();
+
+    char *copy = &staging[staged];
+    memcpy(copy, data, size);
+    staged += size;
+    // Consecutive short ranges become one span of the staging block
+    if (!spans.empty() && spans.back().data + spans.back().size == copy)
+        spans.back().size += size;
+    else
+        spans.push_back({copy, size});
+}
+
+bool SpanWriter::flush()
+{
+    if (copyTo)
+        return copyTo->flush();
+    if (fd < 0 || error)
+    {
+        spans.clear();
+        staged = 0;
+        return !error && fd >= 0;
+    }
+
+#ifdef _WIN32
+    // No writev, so each span is written on its own
+    for (const Span &span : spans)
+    {
+        const char *data = span.data;
+        size_t size = span.size;
+        while (size > 0 && !error)
+        {
+            int count = _write(fd, data, unsigned(min<size_t>(size, 1 << 30)));
+            error = count <= 0;
+            data += count > 0 ? count : 0;
+            size -= count > 0 ? count : 0;
+        }
+    }
+#else
+    vector<iovec> vectors(min(spans.size(), size_t(IOV_MAX)));
+    size_t next = 0;
+    while (next < spans.size() && !error)
+    {
+        size_t count = min(spans.size() - next, size_t(IOV_MAX));
+        for (size_t i = 0; i < count; ++i)
+        {
+            vectors[i].iov_base = const_cast<char *>(spans[next + i].data);
+            vectors[i].iov_len = spans[next + i].size;
+        }
+
+        // A short write leaves the rest of the batch for another call
+        iovec *pending = vectors.data();
+        size_t left = count;
+        while (left > 0)
+        {
+            ssize_t written = ::writev(fd, pending, int(left));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+            {
+                error = true;
+                break;
+            }
+            while (left > 0 && size_t(written) >= pending->iov_len)
+            {
+                written -= pending->iov_len;
+                ++pending;
+                --left;
+            }
+            if (left > 0)
+            {
+                pending->iov_base = static_cast<char *>(pending->iov_base) + written;
+                pending->iov_len -= written;
+            }
+        }
+        next += count;
+    }
+#endif
+    spans.clear();
+    staged = 0;
+    return !error;
+}
+
+bool SpanWriter::close()
+{
+    bool ok = flush();
+    if (fd >= 0)
+    {
+#ifdef _WIN32
+        ok = _close(fd) == 0 && ok;
+#else
+        ok = ::close(fd) == 0 && ok;
+#endif
+        fd = -1;
+    }
+    return ok;
+}
@@ -0,0 +1,91 @@
+#ifndef SPAN_WRITER_H
+#define SPAN_WRITER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "OutputBuffer.h"
+
+using namespace std;
+
+// Ranges shorter than this are copied into the writer: the kernel spends
+// more per iovec than a copy of this many bytes costs
+const size_t SPAN_COPY_LIMIT = 256;
+
+// Output made of byte ranges that live elsewhere, usually in a mapped
+// input. Ranges that touch are merged into one span. On a file the spans
+// are written with writev, IOV_MAX at a time, so long ranges are never
+// copied in user space and must stay valid until flush. Short ones are
+// gathered in a staging block that is written as one span. Other sinks
+// get a copy through an OutputBuffer as each range is added.
+class SpanWriter
+{
+public:
+    // Unopened writer, see openFile
+    SpanWriter();
+    // Copies every range into output as it is added
+    explicit SpanWriter(OutputBuffer &output);
+    // Flushes, and closes a file opened by openFile
+    ~SpanWriter();
+
+    SpanWriter(const SpanWriter &) = delete;
+    SpanWriter &operator=(const SpanWriter &) = delete;
+
+    // Creates or truncates fileName and writes the spans to it
+    bool openFile(const string &fileName);
+
+    void write(const char *data, size_t size)
+    {
+        if (copyTo)
+        {
+            copyTo->write(data, size);
+            return;
+        }
+        if (size == 0)
+            return;
+        total += size;
+        if (!spans.empty() && spans.back().data + spans.back().size == data)
+        {
+            spans.back().size += size;
+            return;
+        }
+        if (size < SPAN_COPY_LIMIT)
+        {
+            stage(data, size);
+            return;
+        }
+        if (spans.size() == batchSize)
+            flush();
+        spans.push_back({data, size});
+    }
+    void write(string_view text) { write(text.data(), text.size()); }
+
+    // Writes every pending span, returns false once a write failed
+    bool flush();
+    bool close();
+
+    bool failed() const { return error; }
+    size_t size() const { return copyTo ? copyTo->size() : total; }
+
+private:
+    struct Span
+    {
+        const char *data;
+        size_t size;
+    };
+
+    void stage(const char *data, size_t size);
+
+    OutputBuffer *copyTo;
+    int fd;
+    size_t batchSize;
+    vector<Span> spans;
+    string staging; // copies of short ranges, emptied by flush
+    size_t staged;
+    size_t total;
+    bool error;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "StructuralScanner.h"
+
+#include <cstring>
+
+#ifdef XML_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+SimdLevel simdLevel()
+{
+    static const SimdLevel level = []() {
+#ifdef XML_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::Avx2;
+        if (__builtin_cpu_supports("sse2"))
+            return SimdLevel::Sse2;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+static uint64_t byteMaskScalar(const char *block, char ch)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < STRUCTURAL_BLOCK_SIZE; ++i)
+    {
+        if (block[i] == ch)
+            mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+
+#ifdef XML_SIMD_X86
+
+__attribute__((target("sse2"))) static uint64_t byteMaskSse2(const char *block, char ch)
+{
+    const __m128i match = _mm_set1_epi8(ch);
+
+    uint64_t mask = 0;
+    for (int part = 0; part < 4; ++part)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + part * 16));
+        mask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, match)))) << (part * 16);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2"))) static uint64_t byteMaskAvx2(const char *block, char ch)
+{
+    const __m256i match = _mm256_set1_epi8(ch);
+
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32));
+    return uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, match)))) |
+           (uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, match)))) << 32);
+}
+
+#endif
+
+typedef uint64_t (*StructuralKernel)(const char *, char);
+
+struct StructuralDispatch
+{
+    StructuralKernel kernel;
+    const char *name;
+};
+
+static StructuralDispatch selectStructuralKernel()
+{
+    switch (simdLevel())
+    {
+#ifdef XML_SIMD_X86
+    case SimdLevel::Avx2:
+        return {byteMaskAvx2, "avx2"};
+    case SimdLevel::Sse2:
+        return {byteMaskSse2, "sse2"};
+#endif
+    default:
+        return {byteMaskScalar, "scalar"};
+    }
+}
+
+static const StructuralDispatch &structuralDispatch()
+{
+    static const StructuralDispatch dispatch = selectStructuralKernel();
+    return dispatch;
+}
+
+uint64_t byteMask(const char *block, char ch)
+{
+    return structuralDispatch().kernel(block, ch);
+}
+
+const char *structuralKernelName()
+{
+    return structuralDispatch().name;
+}
+
+StructuralScanner::StructuralScanner(string_view input)
+    : input(input), currentBlock(static_cast<size_t>(-1)), openMask(0) {}
+
+void StructuralScanner::loadBlock(size_t block)
+{
+    size_t start = block * STRUCTURAL_BLOCK_SIZE;
+    if (start + STRUCTURAL_BLOCK_SIZE <= input.size())
+    {
+        openMask = byteMask(input.data() + start, '<');
+    }
+    else
+    {
+        // Last partial block is padded with zero bytes, which match nothing
+        char padded[STRUCTURAL_BLOCK_SIZE] = {};
+        memcpy(padded, input.data() + start, input.size() - start);
+        openMask = byteMask(padded, '<');
+    }
+    currentBlock = block;
+}
+
+size_t StructuralScanner::nextOpen(size_t pos)
+{
+    while (pos < input.size())
+    {
+        size_t block = pos / STRUCTURAL_BLOCK_SIZE;
+        if (block != currentBlock)
+            loadBlock(block);
+
+        uint64_t bits = openMask >> (pos % STRUCTURAL_BLOCK_SIZE);
+        if (bits)
+            return pos + lowestSetBit(bits);
+        pos = (block + 1) * STRUCTURAL_BLOCK_SIZE;
+    }
+    return input.size();
+}
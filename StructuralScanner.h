@@ -0,0 +1,73 @@
+#ifndef STRUCTURAL_SCANNER_H
+#define STRUCTURAL_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// Set where the SSE2 and AVX2 kernels can be compiled; whether they can
+// run is up to simdLevel
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XML_SIMD_X86 1
+#endif
+
+const size_t STRUCTURAL_BLOCK_SIZE = 64;
+
+// Widest vector instructions the CPU runs, detected once. Every kernel
+// set in the editor picks its kernel from this.
+enum class SimdLevel
+{
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+SimdLevel simdLevel();
+
+// Index of the lowest set bit; bits must not be zero
+inline int lowestSetBit(uint64_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Bitmap of the bytes equal to ch in one 64-byte block (bit i = byte i).
+// The kernel is picked once at runtime: AVX2 or SSE2 on x86, portable
+// scalar code everywhere else. The scanner looks for '<' with it and
+// LineIndex for '\n'.
+uint64_t byteMask(const char *block, char ch);
+
+// Name of the kernel selected by byteMask ("avx2", "sse2" or "scalar")
+const char *structuralKernelName();
+
+// Forward-only search for markup starts, one 64-byte block at a time. The
+// mask of the current block is cached, so scanning a whole document costs
+// one vector pass over the input no matter how many tags it contains.
+class StructuralScanner
+{
+public:
+    explicit StructuralScanner(string_view input);
+
+    // Position of the next '<' at or after pos, or input size
+    size_t nextOpen(size_t pos);
+
+private:
+    void loadBlock(size_t block);
+
+    string_view input;
+    size_t currentBlock;
+    uint64_t openMask; // '<' bytes of currentBlock
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "TagBalance.h"
+#include "StructuralScanner.h"
+#include "XmlTokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <queue>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+// Documents below this size are not worth splitting across threads
+static const size_t MIN_PARALLEL_SIZE = 1 << 20;
+
+// Whatever is left on the per-name stacks was never closed. Each stack is
+// in offset order, so a k-way merge of them puts the list in order.
+static void mergeOpenStacks(const vector<vector<size_t>> &openByTag, vector<TagRef> &opens)
+{
+    typedef pair<size_t, uint32_t> StackHead; // offset of the next open, tag
+    priority_queue<StackHead, vector<StackHead>, greater<StackHead>> heads;
+    vector<size_t> taken(openByTag.size(), 0);
+    size_t total = 0;
+    for (uint32_t tag = 0; tag < openByTag.size(); ++tag)
+    {
+        total += openByTag[tag].size();
+        if (!openByTag[tag].empty())
+            heads.push({openByTag[tag][0], tag});
+    }
+    opens.reserve(opens.size() + total);
+    while (!heads.empty())
+    {
+        uint32_t tag = heads.top().second;
+        opens.push_back({tag, heads.top().first});
+        heads.pop();
+        if (++taken[tag] < openByTag[tag].size())
+            heads.push({openByTag[tag][taken[tag]], tag});
+    }
+}
+
+TagBalanceSummary summarizeTags(string_view range, TagInterner &tags, bool lastRange)
+{
+    TagBalanceSummary summary;
+    summary.length = range.size();
+
+    vector<vector<size_t>> openByTag; // per tag id: offsets of its unmatched opens
+
+    StructuralScanner scanner(range);
+    XmlToken token;
+    size_t pos = 0;
+
+    while (scanXmlToken(range, pos, lastRange, token, &scanner))
+    {
+        if (token.type != XmlTokenType::StartTag && token.type != XmlTokenType::EndTag)
+            continue;
+
+        uint32_t tag = tags.intern(token.name);
+        if (tag >= openByTag.size())
+            openByTag.resize(tag + 1);
+
+        if (token.type == XmlTokenType::StartTag)
+        {
+            if (!summary.nestingBroken)
+                summary.trailingOpens.push_back(tag);
+            openByTag[tag].push_back(token.offset);
+            continue;
+        }
+
+        if (!summary.nestingBroken)
+        {
+            if (summary.trailingOpens.empty())
+            {
+                summary.leadingCloses.push_back({tag, token.offset});
+            }
+            else if (summary.trailingOpens.back() != tag)
+            {
+                summary.nestingBroken = true;
+                summary.nestingDefect = token.offset;
+                summary.trailingOpens.clear();
+            }
+            else
+            {
+                summary.trailingOpens.pop_back();
+            }
+        }
+
+        if (openByTag[tag].empty())
+            summary.unmatchedCloses.push_back({tag, token.offset});
+        else
+            openByTag[tag].pop_back();
+    }
+
+    // Text may continue in the next range, markup may not
+    if (pos < range.size() && range[pos] == '<')
+        summary.cutToken = true;
+
+    mergeOpenStacks(openByTag, summary.unmatchedOpens);
+    return summary;
+}
+
+void mergeTagNesting(TagBalanceSummary &left, const TagBalanceSummary &right)
+{
+    size_t shift = left.length;
+    left.length += right.length;
+    left.cutToken = left.cutToken || right.cutToken;
+
+    // Strict nesting: closes at the start of right must pop left's opens
+    // exactly. They come before any break inside right, so the first break
+    // is the first of them to miss, or else right's own.
+    if (!left.nestingBroken)
+    {
+        for (const TagRef &close : right.leadingCloses)
+        {
+            if (left.trailingOpens.empty())
+            {
+                left.leadingCloses.push_back({close.tag, close.offset + shift});
+            }
+            else if (left.trailingOpens.back() != close.tag)
+            {
+                left.nestingBroken = true;
+                left.nestingDefect = close.offset + shift;
+                break;
+            }
+            else
+            {
+                left.trailingOpens.pop_back();
+            }
+        }
+        if (!left.nestingBroken && right.nestingBroken)
+        {
+            left.nestingBroken = true;
+            left.nestingDefect = right.nestingDefect + shift;
+        }
+        if (left.nestingBroken)
+            left.trailingOpens.clear();
+        else
+            left.trailingOpens.insert(left.trailingOpens.end(), right.trailingOpens.begin(), right.trailingOpens.end());
+    }
+}
+
+void mergeTagSummaries(TagBalanceSummary &left, const TagBalanceSummary &right)
+{
+    size_t shift = left.length;
+    mergeTagNesting(left, right);
+
+    // Per-name matching: each unmatched close of right takes the most recent
+    // unmatched open of left with the same name
+    if (!right.unmatchedCloses.empty() && !left.unmatchedOpens.empty())
+    {
+        uint32_t maxTag = 0;
+        for (const TagRef &open : left.unmatchedOpens)
+            maxTag = max(maxTag, open.tag);
+
+        vector<vector<size_t>> openByTag(maxTag + 1);
+        for (size_t i = 0; i < left.unmatchedOpens.size(); ++i)
+            openByTag[left.unmatchedOpens[i].tag].push_back(i);
+
+        vector<bool> matched(left.unmatchedOpens.size(), false);
+        for (const TagRef &close : right.unmatchedCloses)
+        {
+            if (close.tag <= maxTag && !openByTag[close.tag].empty())
+            {
+                matched[openByTag[close.tag].back()] = true;
+                openByTag[close.tag].pop_back();
+            }
+            else
+            {
+                left.unmatchedCloses.push_back({close.tag, close.offset + shift});
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < left.unmatchedOpens.size(); ++i)
+        {
+            if (!matched[i])
+                left.unmatchedOpens[kept++] = left.unmatchedOpens[i];
+        }
+        left.unmatchedOpens.resize(kept);
+    }
+    else
+    {
+        for (const TagRef &close : right.unmatchedCloses)
+            left.unmatchedCloses.push_back({close.tag, close.offset + shift});
+    }
+
+    for (const TagRef &open : right.unmatchedOpens)
+        left.unmatchedOpens.push_back({open.tag, open.offset + shift});
+}
+
+void matchTagNames(const TagBalanceSummary *ranges, size_t count, TagBalanceSummary &total)
+{
+    total.unmatchedCloses.clear();
+    total.unmatchedOpens.clear();
+    vector<vector<size_t>> openByTag; // per tag id: offsets of the opens still unmatched
+
+    size_t shift = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // In one range the unmatched closes of a name all come before its
+        // unmatched opens, or they would have matched there
+        for (const TagRef &close : ranges[i].unmatchedCloses)
+        {
+            if (close.tag < openByTag.size() && !openByTag[close.tag].empty())
+                openByTag[close.tag].pop_back();
+            else
+                total.unmatchedCloses.push_back({close.tag, close.offset + shift});
+        }
+        for (const TagRef &open : ranges[i].unmatchedOpens)
+        {
+            if (open.tag >= openByTag.size())
+                openByTag.resize(open.tag + 1);
+            openByTag[open.tag].push_back(open.offset + shift);
+        }
+        shift += ranges[i].length;
+    }
+    mergeOpenStacks(openByTag, total.unmatchedOpens);
+}
+
+void remapTags(TagBalanceSummary &summary, const TagInterner &from, TagInterner &to)
+{
+    vector<uint32_t> ids(from.size());
+    for (uint32_t id = 0; id < from.size(); ++id)
+        ids[id] = to.intern(from.name(id));
+
+    for (TagRef &ref : summary.leadingCloses)
+        ref.tag = ids[ref.tag];
+    for (uint32_t &tag : summary.trailingOpens)
+        tag = ids[tag];
+    for (TagRef &ref : summary.unmatchedCloses)
+        ref.tag = ids[ref.tag];
+    for (TagRef &ref : summary.unmatchedOpens)
+        ref.tag = ids[ref.tag];
+}
+
+bool isBalanced(const TagBalanceSummary &summary)
+{
+    return !summary.nestingBroken && !summary.cutToken &&
+           summary.leadingCloses.empty() && summary.trailingOpens.empty();
+}
+
+// Calls visit(offset) for every unmatched tag in offset order
+template <typename Visitor>
+static void visitMismatches(const TagBalanceSummary &summary, Visitor visit)
+{
+    // Names that balance can still cross; the break is then the error
+    if (summary.nestingBroken && summary.unmatchedCloses.empty() && summary.unmatchedOpens.empty())
+    {
+        visit(summary.nestingDefect);
+        return;
+    }
+
+    // Both lists are already in offset order, so merging them sorts them
+    size_t c = 0, o = 0;
+    while (c < summary.unmatchedCloses.size() || o < summary.unmatchedOpens.size())
+    {
+        if (o == summary.unmatchedOpens.size() ||
+            (c < summary.unmatchedCloses.size() && summary.unmatchedCloses[c].offset < summary.unmatchedOpens[o].offset))
+            visit(summary.unmatchedCloses[c++].offset);
+        else
+            visit(summary.unmatchedOpens[o++].offset);
+    }
+}
+
+size_t mismatchCount(const TagBalanceSummary &summary)
+{
+    size_t count = summary.unmatchedCloses.size() + summary.unmatchedOpens.size();
+    return count == 0 && summary.nestingBroken ? 1 : count;
+}
+
+vector<size_t> mismatchPositions(const TagBalanceSummary &summary)
+{
+    vector<size_t> positions;
+    positions.reserve(mismatchCount(summary));
+    visitMismatches(summary, [&](size_t offset) { positions.push_back(offset); });
+    return positions;
+}
+
+vector<TagError> mismatchErrors(const TagBalanceSummary &summary, const LineIndex &lines, size_t limit)
+{
+    vector<TagError> errors;
+    errors.reserve(min(limit, mismatchCount(summary)));
+    visitMismatches(summary, [&](size_t offset) {
+        if (errors.size() == limit)
+            return;
+        TextPosition position = lines.position(offset);
+        errors.push_back({offset, position.line, position.column});
+    });
+    return errors;
+}
+
+TagBalanceSummary summarizeTagsParallel(string_view xml, unsigned threads, TagInterner &tags)
+{
+    if (threads <= 1 || xml.size() < MIN_PARALLEL_SIZE)
+        return summarizeTags(xml, tags);
+
+    // A few chunks per thread so uneven chunks still balance out
+    vector<size_t> bounds = splitAtMarkup(xml, static_cast<size_t>(threads) * 4);
+
+    size_t chunks = bounds.size() - 1;
+    vector<TagBalanceSummary> summaries(chunks);
+    vector<TagInterner> interners(chunks);
+    atomic<size_t> nextChunk(0);
+
+    auto worker = [&]() {
+        for (size_t i = nextChunk++; i < chunks; i = nextChunk++)
+        {
+            string_view range = xml.substr(bounds[i], bounds[i + 1] - bounds[i]);
+            summaries[i] = summarizeTags(range, interners[i], i + 1 == chunks);
+        }
+    };
+
+    vector<thread> pool;
+    for (size_t t = 0; t < min<size_t>(threads, chunks); ++t)
+        pool.emplace_back(worker);
+    for (thread &t : pool)
+        t.join();
+
+    // A split inside a comment or tag cannot be merged correctly
+    for (const TagBalanceSummary &summary : summaries)
+    {
+        if (summary.cutToken)
+            return summarizeTags(xml, tags);
+    }
+
+    TagBalanceSummary total;
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        remapTags(summaries[i], interners[i], tags);
+        mergeTagSummaries(total, summaries[i]);
+    }
+    return total;
+}
@@ -0,0 +1,86 @@
+#ifndef TAG_BALANCE_H
+#define TAG_BALANCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "LineIndex.h"
+#include "TagInterner.h"
+
+using namespace std;
+
+// Tag left unmatched inside a summarized range
+struct TagRef
+{
+    uint32_t tag;  // interned tag id
+    size_t offset; // offset of its '<' relative to the range start
+};
+
+// Reduction of a byte range for bracket matching. Summaries of adjacent
+// ranges merge associatively, like a parallel bracket-matching scan.
+struct TagBalanceSummary
+{
+    size_t length = 0;         // bytes covered by the range
+    bool cutToken = false;     // range ends inside a tag or comment
+    bool nestingBroken = false; // a close tag met a different open tag
+    size_t nestingDefect = 0;   // offset of the first such close tag
+
+    // Strict nesting: every close tag matches the innermost open tag
+    vector<TagRef> leadingCloses;   // closes left for ranges before, in order, up to the break
+    vector<uint32_t> trailingOpens; // opens left for ranges after, bottom first
+
+    // Per-name matching, as verify reports it: a close matches the most
+    // recent unmatched open with the same name
+    vector<TagRef> unmatchedCloses; // in offset order
+    vector<TagRef> unmatchedOpens;  // in offset order
+};
+
+// Summarizes one range; tag ids come from tags. lastRange is false for
+// ranges that are followed by more input, so a token running past the end
+// of the range is reported through cutToken instead of being read.
+TagBalanceSummary summarizeTags(string_view range, TagInterner &tags, bool lastRange = true);
+
+// Appends the range summarized by right to the one summarized by left
+void mergeTagSummaries(TagBalanceSummary &left, const TagBalanceSummary &right);
+// The same for the length, flags and strict-nesting leftovers only; the
+// per-name lists of left are left alone
+void mergeTagNesting(TagBalanceSummary &left, const TagBalanceSummary &right);
+
+// Sets the per-name lists of total to those of the count consecutive
+// ranges, matched in one pass with a stack per tag rather than a merge per
+// range. Offsets are from the start of the first range.
+void matchTagNames(const TagBalanceSummary *ranges, size_t count, TagBalanceSummary &total);
+
+// Rewrites the ids of summary from one interner to another
+void remapTags(TagBalanceSummary &summary, const TagInterner &from, TagInterner &to);
+
+// True when the whole document nests correctly
+bool isBalanced(const TagBalanceSummary &summary);
+
+// Offsets of every unmatched tag, sorted. When the names balance but the
+// nesting does not, as in <a><b></a></b>, the close tag that broke the
+// nesting is the one error.
+vector<size_t> mismatchPositions(const TagBalanceSummary &summary);
+// Number of offsets mismatchPositions lists
+size_t mismatchCount(const TagBalanceSummary &summary);
+
+// Unmatched tag with its place in the document
+struct TagError
+{
+    size_t offset; // offset of the tag's '<'
+    size_t line;   // 1-based
+    size_t column; // 1-based, in bytes
+};
+
+// The first limit unmatched tags of a whole-document summary, sorted by offset
+vector<TagError> mismatchErrors(const TagBalanceSummary &summary, const LineIndex &lines, size_t limit = SIZE_MAX);
+
+// Summarizes a whole document on several threads. The input is split at
+// '<' boundaries into chunks that are summarized concurrently and merged
+// in order; if a split lands inside markup the document is summarized
+// sequentially instead.
+TagBalanceSummary summarizeTagsParallel(string_view xml, unsigned threads, TagInterner &tags);
+
+#endif
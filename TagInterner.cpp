@@ -0,0 +1,95 @@
+#include "TagInterner.h"
+
+using namespace std;
+
+TagInterner::TagInterner() : slots(64, NO_TAG)
+{
+    for (uint32_t &entry : cache)
+        entry = NO_TAG;
+}
+
+size_t TagInterner::cacheSlot(string_view name)
+{
+    if (name.empty())
+        return 0;
+    return (name.size() * 7 + static_cast<unsigned char>(name.front()) * 3 +
+            static_cast<unsigned char>(name.back())) & 63;
+}
+
+uint64_t TagInterner::hash(string_view name)
+{
+    // FNV-1a: tag names are short, so a byte loop is cheaper than anything fancier
+    uint64_t value = 14695981039346656037ull;
+    for (char ch : name)
+    {
+        value ^= static_cast<unsigned char>(ch);
+        value *= 1099511628211ull;
+    }
+    return value;
+}
+
+uint32_t TagInterner::find(string_view name) const
+{
+    uint32_t cached = cache[cacheSlot(name)];
+    if (cached != NO_TAG && names[cached] == name)
+        return cached;
+
+    uint64_t value = hash(name);
+    size_t mask = slots.size() - 1;
+    for (size_t slot = value & mask;; slot = (slot + 1) & mask)
+    {
+        uint32_t id = slots[slot];
+        if (id == NO_TAG)
+            return NO_TAG;
+        if (hashes[id] == value && names[id] == name)
+            return id;
+    }
+}
+
+uint32_t TagInterner::intern(string_view name)
+{
+    uint32_t &cached = cache[cacheSlot(name)];
+    if (cached != NO_TAG && names[cached] == name)
+        return cached;
+
+    uint64_t value = hash(name);
+    size_t mask = slots.size() - 1;
+    size_t slot = value & mask;
+    for (;; slot = (slot + 1) & mask)
+    {
+        uint32_t id = slots[slot];
+        if (id == NO_TAG)
+            break;
+        if (hashes[id] == value && names[id] == name)
+        {
+            cached = id;
+            return id;
+        }
+    }
+
+    uint32_t id = static_cast<uint32_t>(names.size());
+    storage.emplace_back(name);
+    names.push_back(storage.back());
+    hashes.push_back(value);
+    slots[slot] = id;
+    cached = id;
+
+    // Keep the load factor under one half
+    if (names.size() * 2 > slots.size())
+        grow();
+    return id;
+}
+
+void TagInterner::grow()
+{
+    vector<uint32_t> larger(slots.size() * 2, NO_TAG);
+    size_t mask = larger.size() - 1;
+    for (uint32_t id = 0; id < names.size(); ++id)
+    {
+        size_t slot = hashes[id] & mask;
+        while (larger[slot] != NO_TAG)
+            slot = (slot + 1) & mask;
+        larger[slot] = id;
+    }
+    slots.swap(larger);
+}
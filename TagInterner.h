@@ -0,0 +1,44 @@
+#ifndef TAG_INTERNER_H
+#define TAG_INTERNER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Maps tag names to dense 32-bit ids with an open-addressing hash table.
+// Names are copied once into the interner, so ids stay valid after the
+// buffer they were read from is gone.
+class TagInterner
+{
+public:
+    TagInterner();
+
+    // Id of name, adding it on first sight
+    uint32_t intern(string_view name);
+    // Id of name, or NO_TAG if it was never interned
+    uint32_t find(string_view name) const;
+
+    string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    static const uint32_t NO_TAG = UINT32_MAX;
+
+private:
+    static uint64_t hash(string_view name);
+    static size_t cacheSlot(string_view name);
+    void grow();
+
+    // Small direct-mapped cache in front of the table: vocabularies have few
+    // distinct tags, so most lookups are one length check and one memcmp
+    uint32_t cache[64];
+    vector<uint32_t> slots;     // id per slot, NO_TAG when empty
+    vector<uint64_t> hashes;    // hash per id
+    vector<string_view> names;  // name per id, backed by storage
+    deque<string> storage;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "TagRepair.h"
+#include "TagInterner.h"
+#include "XmlTokenizer.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// Insertions at one offset put the close of the tag before it first
+static bool editBefore(const RepairEdit &a, const RepairEdit &b)
+{
+    if (a.offset != b.offset)
+        return a.offset < b.offset;
+    return a.inserted.compare(0, 2, "</") == 0 && b.inserted.compare(0, 2, "</") != 0;
+}
+
+vector<RepairEdit> planTagRepairs(string_view xml)
+{
+    struct OpenTag
+    {
+        uint32_t tag;
+        size_t end; // offset just past the open tag
+        string_view name;
+    };
+
+    vector<RepairEdit> edits;
+    TagInterner tags;
+    vector<OpenTag> stack;
+    vector<size_t> openCount; // per tag id: open tags of that name on the stack
+
+    auto closeUnclosed = [&](const OpenTag &open) {
+        edits.push_back({open.end, 0, "</" + string(open.name) + ">"});
+    };
+
+    XmlTokenizer tokenizer(xml);
+    XmlToken token;
+    while (tokenizer.next(token))
+    {
+        if (token.type != XmlTokenType::StartTag && token.type != XmlTokenType::EndTag)
+            continue;
+
+        uint32_t tag = tags.intern(token.name);
+        if (tag >= openCount.size())
+            openCount.resize(tag + 1, 0);
+
+        if (token.type == XmlTokenType::StartTag)
+        {
+            stack.push_back({tag, token.offset + token.raw.size(), token.name});
+            ++openCount[tag];
+            continue;
+        }
+
+        if (openCount[tag] == 0)
+        {
+            edits.push_back({token.offset, 0, "<" + string(token.name) + ">"});
+            continue;
+        }
+        while (stack.back().tag != tag)
+        {
+            closeUnclosed(stack.back());
+            --openCount[stack.back().tag];
+            stack.pop_back();
+        }
+        --openCount[tag];
+        stack.pop_back();
+    }
+    for (const OpenTag &open : stack)
+        closeUnclosed(open);
+
+    // Unclosed tags are found innermost first, so the list needs sorting
+    stable_sort(edits.begin(), edits.end(), editBefore);
+    return edits;
+}
+
+// Calls emit(span) for every piece of the repaired document, in order
+template <typename Emitter>
+static void emitRepaired(string_view xml, const vector<RepairEdit> &edits, Emitter emit)
+{
+    size_t copied = 0;
+    for (const RepairEdit &edit : edits)
+    {
+        size_t offset = min(max(edit.offset, copied), xml.size());
+        if (offset > copied)
+            emit(xml.substr(copied, offset - copied));
+        if (!edit.inserted.empty())
+            emit(string_view(edit.inserted));
+        copied = min(offset + edit.removed, xml.size());
+    }
+    if (copied < xml.size())
+        emit(xml.substr(copied));
+}
+
+void writeRepaired(string_view xml, const vector<RepairEdit> &edits, ostream &out)
+{
+    emitRepaired(xml, edits, [&](string_view span) { out.write(span.data(), span.size()); });
+}
+
+void writeRepaired(string_view xml, const vector<RepairEdit> &edits, string &out)
+{
+    size_t total = xml.size();
+    for (const RepairEdit &edit : edits)
+        total += edit.inserted.size();
+    out.reserve(out.size() + total);
+    emitRepaired(xml, edits, [&](string_view span) { out.append(span.data(), span.size()); });
+}
@@ -0,0 +1,34 @@
+#ifndef TAG_REPAIR_H
+#define TAG_REPAIR_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+using namespace std;
+
+// One change to the original document: removed bytes at offset are
+// replaced by inserted. Offsets always refer to the unmodified input.
+struct RepairEdit
+{
+    size_t offset;
+    size_t removed;
+    string inserted;
+};
+
+// Edits that make every tag nest. Tags are matched with a stack: a close
+// tag that misses the innermost open tag ends the open tags above its
+// own, and one with no open tag of its name is left over. An open tag
+// left unclosed is closed right after itself and a leftover close tag
+// gets an open tag right before it. The edits come out sorted.
+vector<RepairEdit> planTagRepairs(string_view xml);
+
+// Writes xml with edits applied in one pass, copying the untouched spans
+// straight from xml. Edits must be sorted by offset and must not overlap.
+void writeRepaired(string_view xml, const vector<RepairEdit> &edits, ostream &out);
+void writeRepaired(string_view xml, const vector<RepairEdit> &edits, string &out);
+
+#endif
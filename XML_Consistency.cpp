@@ -1,3 +1,5 @@
+#include <cstdint>
+#include <memory>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -5,206 +7,166 @@
 #include <vector>
 #include <string>
 #include <stack>
+#include <string_view>
 
-using namespace std;
-
-bool        checkXMLConsistency    (string xml);
-vector<int> findMismatchedTags     (string xml);
-string      correctMismatchedTags  (string xml, vector<int> tag_index);
-string      readXMLFile            (string fileName);
+#include "LineIndex.h"
+#include "TagBalance.h"
+#include "TagInterner.h"
+#include "XmlSchema.h"
+#include "XmlTokenizer.h"
 
-void heapSort  (vector<int>& arr , int n);
-void buildHeap (vector<int>& arr, int n);
-void heapify   (vector<int>& arr, int n , int i);
+using namespace std;
 
-void heapify(vector<int>& arr, int n , int i)
-{
-    int l = 2*i + 1;
-    int r = 2*i + 2;
-    int max = i;
-    if (l<n && arr[l] > arr[max])  max = l;
-    if (r<n && arr[r] > arr[max])  max = r;
-    if (max != i)
-    {
-        swap(arr[i] , arr[max]);
-        heapify(arr,n,max);
-    } 
-}
-void buildHeap (vector<int>& arr, int n)
-{
-    for (int i = n/2 -1 ; i>=0 ; i--) heapify(arr,n,i);
-}
-void heapSort(vector<int>& arr , int n)
+struct VerifyOptions
 {
-    buildHeap(arr,n);
-    for (int i = n-1; i>=0 ; i--)
-    {
-        swap(arr[0],arr[i]);
-        heapify(arr,i,0);
-    }
-}
-
+    bool failFast = false;       // stop at the first defect
+    size_t maxErrors = SIZE_MAX; // errors listed in the result, the rest are only counted
+    unsigned threads = 1;
+    const XmlSchema* schema = nullptr; // also check the element structure
+};
 
-
-bool checkXMLConsistency(string xml)               
+struct VerifyResult
+{
+    bool valid = true;
+    size_t errorCount = 0;   // every unmatched tag, listed or not
+    vector<TagError> errors; // the first maxErrors of them, or the first defect with failFast
+    size_t schemaErrorCount = 0;
+    vector<SchemaError> schemaErrors; // up to the first tag error, if there is one
+};
+
+VerifyResult     verifyXML              (string_view xml, const VerifyOptions& options);
+
+// Follows strict nesting up to the first tag that breaks it: a close tag
+// that does not match the innermost open tag, or the innermost tag left open
+// at the end. Returns false if there is none. Otherwise defect is that tag's
+// offset, resume is where the scan stopped and the stacks hold the tags
+// still open there. A schema validator, if given, sees the same tokens up
+// to the defect.
+static bool findFirstDefect(string_view xml, TagInterner& tags, vector<uint32_t>& tagStack,
+                            vector<size_t>& positionStack, size_t& defect, size_t& resume,
+                            SchemaValidator* schema = nullptr)
 {
-    stack<string> tagStack;  
-    int i = 0;
+    XmlTokenizer tokenizer(xml);
+    XmlToken token;
 
-    while (i < xml.length()) 
+    while (tokenizer.next(token))
     {
-        if (xml[i] == '<') 
+        if (token.type == XmlTokenType::StartTag)
         {
-            int closePos = xml.find('>', i);
-
-            string tagContent = xml.substr(i + 1, closePos - i - 1);            // Extract tag content between '<' and '>'
-
-            if (tagContent[0] == '/') 
+            tagStack.push_back(tags.intern(token.name));
+            positionStack.push_back(token.offset);
+            if (schema)
+                schema->startElement(tagStack.back(), token.offset);
+        }
+        else if (token.type == XmlTokenType::EndTag)
+        {
+            // The open tag's interned name is compared directly, no hashing needed
+            if (tagStack.empty() || tags.name(tagStack.back()) != token.name)
             {
-                string tagName = tagContent.substr(1);                         // Remove '/' from the tag
-
-                if (tagStack.empty() || tagStack.top() != tagName) 
-                {
-                    return false;
-                }
-                tagStack.pop();  
-            } 
-            else    tagStack.push(tagContent);
-            
-            i = closePos + 1;
-
-        } 
-        else    i++;
-        
-    }
-
-    return tagStack.empty();
-}
-
-vector<int> findMismatchedTags(string xml)
-{
-    vector<string> tagStack;         // Vector to store open tags
-    vector<int> positionStack;       // Vector to store open tags positions
-    vector<int> mismatchedPositions; // Vector to store mismatched tags positions
-
-    int i = 0;
-    int n = xml.length();
-
-    while (i < n)
-    {
-        if (xml[i] == '<')
+                defect = resume = token.offset;
+                return true;
+            }
+            tagStack.pop_back();
+            positionStack.pop_back();
+            if (schema)
+                schema->endElement(token.offset);
+        }
+        else if (schema)
         {
-
-            int closePos = xml.find('>', i);
-            string tagContent = xml.substr(i + 1, closePos - i - 1);
-            bool isClosingTag = (tagContent[0] == '/');
-            string tagName = isClosingTag ? tagContent.substr(1) : tagContent;
-
-            int tagPosition = i;
-
-            if (isClosingTag)
+            if (token.type == XmlTokenType::SelfClosingTag)
             {
-                bool matched = false;
-                for (int j = tagStack.size() - 1; j >= 0; --j)
-                {
-                    if (tagStack[j] == tagName)
-                    {
-                        tagStack.erase(tagStack.begin() + j);
-                        positionStack.erase(positionStack.begin() + j);
-                        matched = true;
-                        break;
-                    }
-                }
-                if (!matched)
-                {
-                    mismatchedPositions.push_back(tagPosition);
-                }
+                schema->startElement(tags.intern(token.name), token.offset);
+                schema->endElement(token.offset);
             }
-            else
+            else if (token.type == XmlTokenType::Text)
             {
-                tagStack.push_back(tagName);
-                positionStack.push_back(tagPosition);
+                schema->text(token.raw, token.offset);
+            }
+            else if (token.type == XmlTokenType::CData)
+            {
+                schema->text(cdataContent(token.raw), token.offset);
             }
-
-            i = closePos + 1;
-        }
-        else
-        {
-            ++i;
         }
     }
-    mismatchedPositions.insert(mismatchedPositions.end(), positionStack.begin(), positionStack.end());
-    heapSort(mismatchedPositions, mismatchedPositions.size());
-    return mismatchedPositions;
+
+    if (tagStack.empty())
+    {
+        if (schema)
+            schema->finish(xml.size());
+        return false;
+    }
+    defect = positionStack.back();
+    resume = xml.size();
+    return true;
 }
 
-string correctMismatchedTags(string xml, vector<int> tag_index)
+VerifyResult verifyXML(string_view xml, const VerifyOptions& options)
 {
-    vector<string> tagContent;
-
-    string closingTag;
-    int closePos;
-    int pos = 0;
-    int offset = 0; // To keep track of changes in the string length
+    VerifyResult result;
+    TagInterner tags;
 
-    for (int p : tag_index)
+    // The schema follows the nesting of the strict scan, so it needs the
+    // sequential pass
+    if (options.threads > 1 && !options.failFast && !options.schema)
     {
-        closePos = xml.find('>', p);
-        if (xml[p + 1] != '/')
+        TagBalanceSummary summary = summarizeTagsParallel(xml, options.threads, tags);
+        result.valid = isBalanced(summary);
+        if (!result.valid)
         {
-            tagContent.push_back(xml.substr(p + 1, closePos - p - 1));
-        }
-        else
-        {
-            tagContent.push_back(xml.substr(p + 2, closePos - p - 2));
+            result.errorCount = mismatchCount(summary);
+            result.errors = mismatchErrors(summary, LineIndex(xml), options.maxErrors);
         }
+        return result;
     }
 
-    for (int i = 0; i < tagContent.size(); i++)
+    vector<uint32_t> tagStack;
+    vector<size_t> positionStack;
+    size_t defect, resume;
+    unique_ptr<SchemaValidator> schema;
+    if (options.schema)
     {
-        pos = tag_index[i] + offset;
-        if (xml[pos + 1] != '/') // opentag without closetag
-        {
-            closingTag = "</" + tagContent[i] + ">";
-            closePos = xml.find('>', pos) + 1;
-            xml.insert(closePos, closingTag);
-            offset += closingTag.length();
-        }
-        else // closetag without opentag
-        {
-            closingTag = "<" + tagContent[i] + ">";
-            closePos = pos;
-            xml.insert(closePos, closingTag);
-            offset += closingTag.length();
-        }
+        schema.reset(new SchemaValidator(*options.schema, tags, options.failFast ? 1 : options.maxErrors));
     }
-    return xml;
-}
 
-string readXMLFile(string fileName)
-{
-    ifstream file(fileName);
-    if (!file.is_open())
+    bool defective = findFirstDefect(xml, tags, tagStack, positionStack, defect, resume, schema.get());
+    if (schema)
+    {
+        result.schemaErrorCount = schema->errorCount();
+        result.schemaErrors = schema->errors(xml);
+    }
+    result.valid = !defective && result.schemaErrorCount == 0;
+    if (!defective)
     {
-        return "";
+        return result;
     }
 
-    stringstream buffer;
-    buffer << file.rdbuf();
-    string content = buffer.str();
-    string compressedContent;
+    if (options.failFast)
+    {
+        TextPosition position = positionOf(xml, defect);
+        result.errorCount = 1;
+        result.errors.push_back({defect, position.line, position.column});
+        return result;
+    }
 
-    for (int i = 0; i < content.length(); i++)
+    // Up to the defect every close tag matched the innermost open tag, which
+    // is also the latest open tag with its name. The open tags there are
+    // exactly the per-name leftovers, so per-name matching continues from
+    // resume instead of starting the document over. If the names balance
+    // after all, the defect is what broke the nesting and is the error.
+    TagBalanceSummary summary;
+    summary.length = resume;
+    summary.nestingBroken = true;
+    summary.nestingDefect = defect;
+    for (size_t i = 0; i < tagStack.size(); ++i)
     {
-        if (!isspace(content[i]))
-        {
-            compressedContent += content[i];
-        }
-        else if (isalpha(content[i - 1]) || isalpha(content[i + 1])) // keep spaces between tags
-        {
-            compressedContent += content[i];
-        }
+        summary.unmatchedOpens.push_back({tagStack[i], positionStack[i]});
+    }
+    if (resume < xml.size())
+    {
+        mergeTagSummaries(summary, summarizeTags(xml.substr(resume), tags));
     }
 
-    return compressedContent;
+    result.errorCount = mismatchCount(summary);
+    result.errors = mismatchErrors(summary, LineIndex(xml), options.maxErrors);
+    return result;
 }
@@ -0,0 +1,105 @@
+#include "XmlDocument.h"
+#include "XmlTokenizer.h"
+
+using namespace std;
+
+XmlDocument::XmlDocument() : rootIndex(XML_NO_NODE) {}
+
+XmlDocument::XmlDocument(string_view xml) : rootIndex(XML_NO_NODE)
+{
+    parse(xml);
+}
+
+void XmlDocument::clear()
+{
+    nodes.clear();
+    nodes.shrink_to_fit();
+    rootIndex = XML_NO_NODE;
+}
+
+uint32_t XmlDocument::addNode(string_view name, uint32_t parent)
+{
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(XmlNode{name, string_view(), XML_NO_NODE, XML_NO_NODE, XML_NO_NODE});
+
+    if (parent != XML_NO_NODE)
+    {
+        XmlNode &owner = nodes[parent];
+        if (owner.lastChild == XML_NO_NODE)
+            owner.firstChild = index;
+        else
+            nodes[owner.lastChild].nextSibling = index;
+        owner.lastChild = index;
+    }
+    else if (rootIndex == XML_NO_NODE)
+    {
+        rootIndex = index;
+    }
+    return index;
+}
+
+void XmlDocument::parse(string_view xml)
+{
+    nodes.clear();
+    rootIndex = XML_NO_NODE;
+    // Rough guess of one element per 64 bytes keeps regrowth rare
+    nodes.reserve(xml.size() / 64 + 16);
+
+    vector<uint32_t> openNodes;
+    XmlTokenizer tokenizer(xml);
+    XmlToken token;
+
+    while (tokenizer.next(token))
+    {
+        uint32_t parent = openNodes.empty() ? XML_NO_NODE : openNodes.back();
+        switch (token.type)
+        {
+        case XmlTokenType::StartTag:
+            openNodes.push_back(addNode(token.name, parent));
+            break;
+        case XmlTokenType::SelfClosingTag:
+            addNode(token.name, parent);
+            break;
+        case XmlTokenType::EndTag:
+            if (!openNodes.empty())
+                openNodes.pop_back();
+            break;
+        case XmlTokenType::Text:
+            if (parent != XML_NO_NODE)
+            {
+                string_view text = trimWhitespace(token.raw);
+                if (!text.empty())
+                    nodes[parent].text = text;
+            }
+            break;
+        case XmlTokenType::CData:
+            if (parent != XML_NO_NODE)
+            {
+                string_view text = cdataContent(token.raw);
+                if (!text.empty())
+                    nodes[parent].text = text;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+uint32_t XmlDocument::child(uint32_t parent, string_view name) const
+{
+    if (parent == XML_NO_NODE)
+        return XML_NO_NODE;
+    for (uint32_t index = nodes[parent].firstChild; index != XML_NO_NODE; index = nodes[index].nextSibling)
+    {
+        if (nodes[index].name == name)
+            return index;
+    }
+    return XML_NO_NODE;
+}
+
+string_view XmlDocument::childText(uint32_t parent, string_view name) const
+{
+    uint32_t index = child(parent, name);
+    return index == XML_NO_NODE ? string_view() : nodes[index].text;
+}
@@ -0,0 +1,51 @@
+#ifndef XML_DOCUMENT_H
+#define XML_DOCUMENT_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+const uint32_t XML_NO_NODE = UINT32_MAX;
+
+// Compact element node. Names and text are views into the parsed input and
+// links are indices into the owning document, so nodes never own memory.
+struct XmlNode
+{
+    string_view name;
+    string_view text;     // last non-empty (trimmed) text directly inside
+    uint32_t firstChild;
+    uint32_t lastChild;
+    uint32_t nextSibling;
+};
+
+// Element tree built in one tokenizer pass. All nodes live in one
+// contiguous arena that is released in bulk; the input must outlive it.
+class XmlDocument
+{
+public:
+    XmlDocument();
+    explicit XmlDocument(string_view xml);
+
+    // Replaces the current tree with the tree of xml
+    void parse(string_view xml);
+    void clear();
+
+    uint32_t root() const { return rootIndex; }
+    const XmlNode &node(uint32_t index) const { return nodes[index]; }
+    size_t size() const { return nodes.size(); }
+
+    // First child of parent named name, or XML_NO_NODE
+    uint32_t child(uint32_t parent, string_view name) const;
+    // Text of the first child of parent named name, or an empty view
+    string_view childText(uint32_t parent, string_view name) const;
+
+private:
+    uint32_t addNode(string_view name, uint32_t parent);
+
+    vector<XmlNode> nodes;
+    uint32_t rootIndex;
+};
+
+#endif
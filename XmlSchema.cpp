@@ -0,0 +1,515 @@
+#include "XmlSchema.h"
+#include "LineIndex.h"
+#include "MappedFile.h"
+#include "XmlTokenizer.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace std;
+
+const char *const NETWORK_SCHEMA =
+    "# Social network read by the graph commands\n"
+    "@root     = network | users\n"
+    "network   = user*\n"
+    "users     = user*\n"
+    "user      = id name posts? followers?\n"
+    "id        = #text\n"
+    "name      = #text\n"
+    "posts     = post*\n"
+    "post      = #text | body topics?\n"
+    "body      = #text\n"
+    "topics    = topic*\n"
+    "topic     = #text\n"
+    "followers = follower*\n"
+    "follower  = id\n";
+
+namespace
+{
+    // Glushkov construction: every name in a model is a position, and a
+    // fragment is summed up by whether it matches nothing, the positions it
+    // can start with and the positions it can end with
+    struct Fragment
+    {
+        bool nullable = true;
+        vector<int> first;
+        vector<int> last;
+    };
+
+    void addAll(vector<int> &to, const vector<int> &from)
+    {
+        to.insert(to.end(), from.begin(), from.end());
+    }
+
+    class ModelParser
+    {
+    public:
+        ModelParser(string_view text, vector<string> &names, vector<vector<int>> &follow)
+            : text(text), pos(0), names(names), follow(follow) {}
+
+        bool parse(Fragment &model, bool &allowsText, string &error)
+        {
+            textSeen = false;
+            if (!choice(model, error))
+                return false;
+            skipSpace();
+            if (pos < text.size())
+            {
+                error = "unexpected '" + string(1, text[pos]) + "'";
+                return false;
+            }
+            allowsText = textSeen;
+            return true;
+        }
+
+    private:
+        void skipSpace()
+        {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+                ++pos;
+        }
+
+        static bool isNameChar(char c)
+        {
+            return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == ':' || c == '-' || c == '.';
+        }
+
+        // Lets every position in starts follow every position in ends
+        void link(const vector<int> &ends, const vector<int> &starts)
+        {
+            for (int end : ends)
+                addAll(follow[end], starts);
+        }
+
+        bool choice(Fragment &result, string &error)
+        {
+            if (!sequence(result, error))
+                return false;
+            skipSpace();
+            while (pos < text.size() && text[pos] == '|')
+            {
+                ++pos;
+                Fragment option;
+                if (!sequence(option, error))
+                    return false;
+                result.nullable = result.nullable || option.nullable;
+                addAll(result.first, option.first);
+                addAll(result.last, option.last);
+                skipSpace();
+            }
+            return true;
+        }
+
+        bool sequence(Fragment &result, string &error)
+        {
+            bool empty = true;
+            for (;;)
+            {
+                skipSpace();
+                if (pos == text.size() || text[pos] == '|' || text[pos] == ')')
+                    break;
+
+                Fragment item;
+                if (!repeated(item, error))
+                    return false;
+                if (empty)
+                {
+                    result = item;
+                    empty = false;
+                    continue;
+                }
+                link(result.last, item.first);
+                if (result.nullable)
+                    addAll(result.first, item.first);
+                if (item.nullable)
+                    addAll(item.last, result.last);
+                result.last = move(item.last);
+                result.nullable = result.nullable && item.nullable;
+            }
+            if (empty)
+            {
+                error = "expected a name, #text or '('";
+                return false;
+            }
+            return true;
+        }
+
+        bool repeated(Fragment &result, string &error)
+        {
+            if (!atom(result, error))
+                return false;
+            while (pos < text.size() && (text[pos] == '?' || text[pos] == '*' || text[pos] == '+'))
+            {
+                char op = text[pos++];
+                if (op != '?')
+                    link(result.last, result.first);
+                if (op != '+')
+                    result.nullable = true;
+            }
+            return true;
+        }
+
+        bool atom(Fragment &result, string &error)
+        {
+            if (text[pos] == '(')
+            {
+                ++pos;
+                if (!choice(result, error))
+                    return false;
+                if (pos == text.size() || text[pos] != ')')
+                {
+                    error = "missing ')'";
+                    return false;
+                }
+                ++pos;
+                return true;
+            }
+            if (text.substr(pos, 5) == "#text" && (pos + 5 == text.size() || !isNameChar(text[pos + 5])))
+            {
+                pos += 5;
+                textSeen = true;
+                return true;
+            }
+
+            size_t start = pos;
+            while (pos < text.size() && isNameChar(text[pos]))
+                ++pos;
+            if (pos == start)
+            {
+                error = "unexpected '" + string(1, text[pos]) + "'";
+                return false;
+            }
+            string name(text.substr(start, pos - start));
+            if (name == "EMPTY")
+                return true;
+
+            int position = int(names.size());
+            names.push_back(name);
+            follow.emplace_back();
+            result.nullable = false;
+            result.first.assign(1, position);
+            result.last.assign(1, position);
+            return true;
+        }
+
+        string_view text;
+        size_t pos;
+        bool textSeen = false;
+        vector<string> &names;
+        vector<vector<int>> &follow;
+    };
+
+    // One declaration before its model is turned into states
+    struct Declaration
+    {
+        size_t line;
+        string name;
+        bool any = false;
+        bool text = false;
+        Fragment model;
+        vector<string> names;       // element name per position
+        vector<vector<int>> follow; // positions that may follow each position
+    };
+
+    void sortUnique(vector<int> &set)
+    {
+        sort(set.begin(), set.end());
+        set.erase(unique(set.begin(), set.end()), set.end());
+    }
+}
+
+bool XmlSchema::compile(string_view source, string &error)
+{
+    elements.clear();
+    ids.clear();
+    transitions.clear();
+    accepts.clear();
+
+    vector<Declaration> declarations;
+    Declaration root;
+    bool hasRoot = false;
+
+    size_t lineNumber = 0;
+    while (!source.empty())
+    {
+        size_t end = source.find('\n');
+        string_view line = trimWhitespace(source.substr(0, end));
+        source = end == string_view::npos ? string_view() : source.substr(end + 1);
+        ++lineNumber;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        size_t equals = line.find('=');
+        Declaration declaration;
+        declaration.line = lineNumber;
+        declaration.name = string(trimWhitespace(line.substr(0, equals)));
+        if (equals == string_view::npos || declaration.name.empty())
+        {
+            error = "line " + to_string(lineNumber) + ": expected 'name = model'";
+            return false;
+        }
+
+        string_view model = trimWhitespace(line.substr(equals + 1));
+        if (model == "ANY")
+        {
+            declaration.any = true;
+        }
+        else
+        {
+            ModelParser parser(model, declaration.names, declaration.follow);
+            string message;
+            if (!parser.parse(declaration.model, declaration.text, message))
+            {
+                error = "line " + to_string(lineNumber) + ": " + message;
+                return false;
+            }
+        }
+
+        if (declaration.name == "@root")
+        {
+            root = move(declaration);
+            hasRoot = true;
+            continue;
+        }
+        if (ids.count(declaration.name))
+        {
+            error = "line " + to_string(lineNumber) + ": " + declaration.name + " is declared twice";
+            return false;
+        }
+        ids[declaration.name] = int32_t(declarations.size());
+        declarations.push_back(move(declaration));
+    }
+
+    if (declarations.empty())
+    {
+        error = "no elements declared";
+        return false;
+    }
+    if (!hasRoot)
+    {
+        // The first declared element is the only allowed root
+        root.line = declarations[0].line;
+        root.names.push_back(declarations[0].name);
+        root.follow.emplace_back();
+        root.model.nullable = false;
+        root.model.first.assign(1, 0);
+        root.model.last.assign(1, 0);
+    }
+    root.name = "@root";
+    root.text = false;
+    declarations.push_back(move(root));
+
+    columns = declarations.size() - 1;
+    elements.resize(declarations.size());
+
+    for (size_t id = 0; id < declarations.size(); ++id)
+    {
+        Declaration &declaration = declarations[id];
+        Element &element = elements[id];
+        element.name = declaration.name;
+        element.text = declaration.text;
+        element.any = declaration.any;
+        if (declaration.any)
+        {
+            // One accepting state that loops on every declared element
+            element.text = true;
+            element.start = int32_t(accepts.size());
+            accepts.push_back(true);
+            transitions.resize(transitions.size() + columns, element.start);
+            continue;
+        }
+
+        vector<int32_t> symbols;
+        for (const string &name : declaration.names)
+        {
+            auto found = ids.find(name);
+            if (found == ids.end())
+            {
+                error = "line " + to_string(declaration.line) + ": " + name + " is used but not declared";
+                return false;
+            }
+            symbols.push_back(found->second);
+        }
+
+        vector<bool> isLast(symbols.size(), false);
+        for (int position : declaration.model.last)
+            isLast[position] = true;
+        for (vector<int> &next : declaration.follow)
+            sortUnique(next);
+
+        // Subset construction. A state is the set of positions just
+        // matched; the start state is the empty set.
+        map<vector<int>, int32_t> states;
+        vector<vector<int>> pending;
+        auto addState = [&](vector<int> &&set) {
+            auto found = states.find(set);
+            if (found != states.end())
+                return found->second;
+
+            int32_t state = int32_t(accepts.size());
+            bool accepting = set.empty() ? declaration.model.nullable : false;
+            for (int position : set)
+                accepting = accepting || isLast[position];
+            accepts.push_back(accepting);
+            transitions.resize(transitions.size() + columns, NO_STATE);
+            states.emplace(set, state);
+            pending.push_back(move(set));
+            return state;
+        };
+
+        element.start = addState(vector<int>());
+        while (!pending.empty())
+        {
+            vector<int> set = move(pending.back());
+            pending.pop_back();
+            int32_t state = states[set];
+
+            vector<int> candidates;
+            if (set.empty())
+                candidates = declaration.model.first;
+            for (int position : set)
+                addAll(candidates, declaration.follow[position]);
+            sortUnique(candidates);
+
+            // Group the candidates by the element they match
+            map<int32_t, vector<int>> targets;
+            for (int position : candidates)
+                targets[symbols[position]].push_back(position);
+            for (auto &target : targets)
+            {
+                int32_t next = addState(move(target.second));
+                transitions[size_t(state) * columns + target.first] = next;
+            }
+        }
+    }
+    return true;
+}
+
+int32_t XmlSchema::find(string_view name) const
+{
+    auto found = ids.find(string(name));
+    return found == ids.end() ? NO_ELEMENT : found->second;
+}
+
+string XmlSchema::expected(int32_t state, int32_t element) const
+{
+    vector<string> options;
+    for (size_t column = 0; column < columns; ++column)
+    {
+        if (next(state, int32_t(column)) != NO_STATE)
+            options.push_back("<" + elements[column].name + ">");
+    }
+    if (accepting(state))
+        options.push_back(element == document() ? "the end of the document" : "</" + elements[element].name + ">");
+
+    string result;
+    for (size_t i = 0; i < options.size(); ++i)
+    {
+        if (i > 0)
+            result += i + 1 == options.size() ? " or " : ", ";
+        result += options[i];
+    }
+    return result.empty() ? "nothing" : result;
+}
+
+bool loadSchema(const string &spec, XmlSchema &schema, string &error)
+{
+    if (spec == "network")
+        return schema.compile(NETWORK_SCHEMA, error);
+
+    MappedFile file;
+    if (!file.open(spec))
+    {
+        error = "cannot read schema " + spec;
+        return false;
+    }
+    if (!schema.compile(file.view(), error))
+    {
+        error = spec + ", " + error;
+        return false;
+    }
+    return true;
+}
+
+SchemaValidator::SchemaValidator(const XmlSchema &schema, const TagInterner &tags, size_t maxErrors)
+    : schema(schema), tags(tags), maxErrors(maxErrors)
+{
+    stack.push_back({schema.document(), schema.start(schema.document())});
+}
+
+void SchemaValidator::report(size_t offset, string message)
+{
+    if (count++ < maxErrors)
+        found.emplace_back(offset, move(message));
+}
+
+string SchemaValidator::describe(int32_t element) const
+{
+    return element == schema.document() ? "the document" : "<" + schema.name(element) + ">";
+}
+
+void SchemaValidator::startElement(uint32_t tag, size_t offset)
+{
+    if (tag >= symbols.size())
+        symbols.resize(tags.size(), UNRESOLVED);
+    int32_t element = symbols[tag];
+    if (element == UNRESOLVED)
+        element = symbols[tag] = schema.find(tags.name(tag));
+
+    // Common case: a declared child the parent's model accepts
+    Frame &parent = stack.back();
+    if (element != XmlSchema::NO_ELEMENT && parent.element != SKIPPED)
+    {
+        int32_t next = schema.next(parent.state, element);
+        if (next == XmlSchema::NO_STATE)
+        {
+            // The parent keeps its state, so one stray element is one error
+            report(offset, "<" + schema.name(element) + "> is not allowed in " + describe(parent.element) +
+                               " here, expected " + schema.expected(parent.state, parent.element));
+        }
+        else
+        {
+            parent.state = next;
+        }
+        stack.push_back({element, schema.start(element)});
+        return;
+    }
+
+    if (element == XmlSchema::NO_ELEMENT && parent.element != SKIPPED && !schema.allowsAny(parent.element))
+        report(offset, "<" + string(tags.name(tag)) + "> is not declared in the schema");
+    stack.push_back({SKIPPED, XmlSchema::NO_STATE});
+}
+
+void SchemaValidator::reportEnd(const Frame &frame, size_t offset)
+{
+    report(offset, describe(frame.element) + " ends too early, expected " + schema.expected(frame.state, frame.element));
+}
+
+void SchemaValidator::checkText(int32_t element, string_view text, size_t offset)
+{
+    // Whitespace between elements is not content
+    if (!trimWhitespace(text).empty())
+        report(offset, "text is not allowed in " + describe(element));
+}
+
+void SchemaValidator::finish(size_t offset)
+{
+    while (stack.size() > 1)
+        endElement(offset);
+    endElement(offset);
+}
+
+vector<SchemaError> SchemaValidator::errors(string_view xml) const
+{
+    vector<SchemaError> result;
+    if (found.empty())
+        return result;
+
+    LineIndex lines(xml);
+    for (const auto &error : found)
+    {
+        TextPosition position = lines.position(error.first);
+        result.push_back({error.first, position.line, position.column, error.second});
+    }
+    return result;
+}
@@ -0,0 +1,137 @@
+#ifndef XML_SCHEMA_H
+#define XML_SCHEMA_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "TagInterner.h"
+
+using namespace std;
+
+// Element structure a document must follow. The source has one
+// declaration per line,
+//
+//   name = model
+//
+// where model is a regular expression over child element names: a
+// sequence is written by juxtaposition, '|' separates choices, '?', '*'
+// and '+' repeat, and parentheses group. "#text" allows character data,
+// EMPTY allows no content and ANY allows any. "@root = model" lists the
+// allowed document elements; without it the first declared element is
+// the root. Lines starting with '#' are comments.
+//
+// Every content model is compiled into a DFA over the declared names,
+// stored in one transition table with a row per state.
+class XmlSchema
+{
+public:
+    // Returns false with the offending line in error if source is invalid
+    bool compile(string_view source, string &error);
+
+    // Id of a declared element, or NO_ELEMENT
+    int32_t find(string_view name) const;
+
+    const string &name(int32_t element) const { return elements[element].name; }
+    int32_t start(int32_t element) const { return elements[element].start; }
+    bool allowsText(int32_t element) const { return elements[element].text; }
+    bool allowsAny(int32_t element) const { return elements[element].any; }
+    // Pseudo-element whose content is the document element
+    int32_t document() const { return int32_t(elements.size()) - 1; }
+
+    int32_t next(int32_t state, int32_t element) const { return transitions[size_t(state) * columns + element]; }
+    bool accepting(int32_t state) const { return accepts[state] != 0; }
+    // What may come in state, e.g. "<id>, <name> or </user>"
+    string expected(int32_t state, int32_t element) const;
+
+    static constexpr int32_t NO_ELEMENT = -1;
+    static constexpr int32_t NO_STATE = -1;
+
+private:
+    struct Element
+    {
+        string name;
+        int32_t start = NO_STATE;
+        bool text = false;
+        bool any = false;
+    };
+
+    vector<Element> elements; // declared elements, then the document
+    unordered_map<string, int32_t> ids;
+    size_t columns = 0;       // one per declared element
+    vector<int32_t> transitions;
+    vector<uint8_t> accepts;
+};
+
+// The shape Graph reads: network/user/{id,name,posts/post,followers/follower/id}
+extern const char *const NETWORK_SCHEMA;
+
+// Compiles the schema in file spec, or the built-in one for "network"
+bool loadSchema(const string &spec, XmlSchema &schema, string &error);
+
+struct SchemaError
+{
+    size_t offset;
+    size_t line;
+    size_t column;
+    string message;
+};
+
+// Checks the events of a tokenizer pass against a schema. Tag ids come
+// from the interner of that pass, so each distinct name is looked up in
+// the schema once and every tag after that costs one table read.
+class SchemaValidator
+{
+public:
+    SchemaValidator(const XmlSchema &schema, const TagInterner &tags, size_t maxErrors = SIZE_MAX);
+
+    void startElement(uint32_t tag, size_t offset);
+    void endElement(size_t offset)
+    {
+        const Frame &frame = stack.back();
+        if (frame.element != SKIPPED && !schema.accepting(frame.state))
+            reportEnd(frame, offset);
+        stack.pop_back();
+    }
+    void text(string_view text, size_t offset)
+    {
+        int32_t element = stack.back().element;
+        if (element != SKIPPED && !schema.allowsText(element))
+            checkText(element, text, offset);
+    }
+    // End of a document whose tags all matched
+    void finish(size_t offset);
+
+    size_t errorCount() const { return count; }
+    // The first maxErrors errors with their lines and columns
+    vector<SchemaError> errors(string_view xml) const;
+
+private:
+    // Open element and the state of its content model. SKIPPED marks
+    // subtrees of undeclared elements, which are not checked.
+    struct Frame
+    {
+        int32_t element;
+        int32_t state;
+    };
+
+    static constexpr int32_t SKIPPED = -1;
+    static constexpr int32_t UNRESOLVED = -2;
+
+    void report(size_t offset, string message);
+    void reportEnd(const Frame &frame, size_t offset);
+    void checkText(int32_t element, string_view text, size_t offset);
+    string describe(int32_t element) const;
+
+    const XmlSchema &schema;
+    const TagInterner &tags;
+    size_t maxErrors;
+    size_t count = 0;
+    vector<Frame> stack;
+    vector<int32_t> symbols; // schema element per interned tag
+    vector<pair<size_t, string>> found;
+};
+
+#endif
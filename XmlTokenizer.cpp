@@ -0,0 +1,332 @@
+#include "XmlTokenizer.h"
+
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+static bool isXmlSpace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+string_view trimWhitespace(string_view text)
+{
+    size_t start = 0, end = text.size();
+    while (start < end && isXmlSpace(text[start]))
+        ++start;
+    while (end > start && isXmlSpace(text[end - 1]))
+        --end;
+    return text.substr(start, end - start);
+}
+
+vector<size_t> splitAtMarkup(string_view input, size_t count)
+{
+    vector<size_t> bounds = {0};
+    for (size_t i = 1; i < count; ++i)
+    {
+        size_t target = input.size() / count * i;
+        if (target <= bounds.back())
+            continue;
+        const void *lt = memchr(input.data() + target, '<', input.size() - target);
+        if (!lt)
+            break;
+        bounds.push_back(static_cast<const char *>(lt) - input.data());
+    }
+    bounds.push_back(input.size());
+    return bounds;
+}
+
+// Position of the next '<' at or after pos, or the input size
+static size_t findOpen(string_view input, size_t pos, StructuralScanner *scanner)
+{
+    if (scanner)
+        return scanner->nextOpen(pos);
+    const void *found = memchr(input.data() + pos, '<', input.size() - pos);
+    return found ? static_cast<const char *>(found) - input.data() : input.size();
+}
+
+namespace
+{
+    // Byte classes the markup DFA tells apart
+    enum LexClass : uint8_t
+    {
+        C_OTHER,
+        C_SPACE,
+        C_GT,
+        C_SLASH,
+        C_BANG,
+        C_QUESTION,
+        C_DQUOTE,
+        C_SQUOTE,
+        C_DASH,
+        C_LBRACKET,
+        C_RBRACKET,
+        CLASS_COUNT
+    };
+
+    // DFA states after the opening '<'. The accepting states come last: the
+    // byte that enters one of them is the last byte of the token.
+    enum LexState : uint8_t
+    {
+        S_OPEN,           // just after '<'
+        S_TAG,            // name and attributes of a start tag
+        S_TAG_DQUOTE,     // inside "..." in a tag
+        S_TAG_SQUOTE,     // inside '...' in a tag
+        S_TAG_SLASH,      // '/' in a start tag, may be "/>"
+        S_END_TAG,        // after "</"
+        S_BANG,           // after "<!"
+        S_BANG_DASH,      // after "<!-"
+        S_COMMENT,        // after "<!--"
+        S_COMMENT_DASH,   // "-" inside a comment
+        S_COMMENT_DASHES, // "--" inside a comment
+        S_PI,             // after "<?"
+        S_PI_QUESTION,    // "?" inside a processing instruction
+        S_CDATA,          // after "<!["
+        S_CDATA_BRACKET,  // "]" inside CDATA
+        S_CDATA_BRACKETS, // "]]" inside CDATA
+        S_DECL,           // <!DOCTYPE and other declarations
+        S_DECL_DQUOTE,
+        S_DECL_SQUOTE,
+        S_SUBSET,         // [...] internal subset of a declaration
+        S_SUBSET_DQUOTE,
+        S_SUBSET_SQUOTE,
+
+        S_DONE_START,
+        S_DONE_SELF_CLOSING,
+        S_DONE_END,
+        S_DONE_COMMENT,
+        S_DONE_PI,
+        S_DONE_CDATA,
+        STATE_COUNT
+    };
+
+    const uint8_t FIRST_DONE = S_DONE_START;
+
+    struct LexTables
+    {
+        uint8_t classOf[256];
+        uint8_t next[FIRST_DONE][CLASS_COUNT];
+        XmlTokenType typeOf[STATE_COUNT]; // token type for a final or unfinished state
+    };
+
+    constexpr LexTables buildLexTables()
+    {
+        LexTables t{};
+
+        for (int ch = 0; ch < 256; ++ch)
+            t.classOf[ch] = C_OTHER;
+        t.classOf[static_cast<uint8_t>(' ')] = C_SPACE;
+        t.classOf[static_cast<uint8_t>('\t')] = C_SPACE;
+        t.classOf[static_cast<uint8_t>('\n')] = C_SPACE;
+        t.classOf[static_cast<uint8_t>('\r')] = C_SPACE;
+        t.classOf[static_cast<uint8_t>('>')] = C_GT;
+        t.classOf[static_cast<uint8_t>('/')] = C_SLASH;
+        t.classOf[static_cast<uint8_t>('!')] = C_BANG;
+        t.classOf[static_cast<uint8_t>('?')] = C_QUESTION;
+        t.classOf[static_cast<uint8_t>('"')] = C_DQUOTE;
+        t.classOf[static_cast<uint8_t>('\'')] = C_SQUOTE;
+        t.classOf[static_cast<uint8_t>('-')] = C_DASH;
+        t.classOf[static_cast<uint8_t>('[')] = C_LBRACKET;
+        t.classOf[static_cast<uint8_t>(']')] = C_RBRACKET;
+
+        // By default every state loops on itself
+        for (int state = 0; state < FIRST_DONE; ++state)
+            for (int cls = 0; cls < CLASS_COUNT; ++cls)
+                t.next[state][cls] = static_cast<uint8_t>(state);
+
+        for (int cls = 0; cls < CLASS_COUNT; ++cls)
+        {
+            t.next[S_OPEN][cls] = S_TAG;
+            t.next[S_TAG_SLASH][cls] = S_TAG;
+            t.next[S_BANG][cls] = S_DECL;
+            t.next[S_BANG_DASH][cls] = S_DECL;
+            t.next[S_COMMENT_DASH][cls] = S_COMMENT;
+            t.next[S_COMMENT_DASHES][cls] = S_COMMENT;
+            t.next[S_PI_QUESTION][cls] = S_PI;
+            t.next[S_CDATA_BRACKET][cls] = S_CDATA;
+            t.next[S_CDATA_BRACKETS][cls] = S_CDATA;
+        }
+
+        t.next[S_OPEN][C_SLASH] = S_END_TAG;
+        t.next[S_OPEN][C_BANG] = S_BANG;
+        t.next[S_OPEN][C_QUESTION] = S_PI;
+        t.next[S_OPEN][C_GT] = S_DONE_START;
+        t.next[S_OPEN][C_DQUOTE] = S_TAG_DQUOTE;
+        t.next[S_OPEN][C_SQUOTE] = S_TAG_SQUOTE;
+
+        t.next[S_TAG][C_DQUOTE] = S_TAG_DQUOTE;
+        t.next[S_TAG][C_SQUOTE] = S_TAG_SQUOTE;
+        t.next[S_TAG][C_SLASH] = S_TAG_SLASH;
+        t.next[S_TAG][C_GT] = S_DONE_START;
+        t.next[S_TAG_DQUOTE][C_DQUOTE] = S_TAG;
+        t.next[S_TAG_SQUOTE][C_SQUOTE] = S_TAG;
+        t.next[S_TAG_SLASH][C_SLASH] = S_TAG_SLASH;
+        t.next[S_TAG_SLASH][C_DQUOTE] = S_TAG_DQUOTE;
+        t.next[S_TAG_SLASH][C_SQUOTE] = S_TAG_SQUOTE;
+        t.next[S_TAG_SLASH][C_GT] = S_DONE_SELF_CLOSING;
+
+        t.next[S_END_TAG][C_GT] = S_DONE_END;
+
+        t.next[S_BANG][C_DASH] = S_BANG_DASH;
+        t.next[S_BANG][C_LBRACKET] = S_CDATA;
+        t.next[S_BANG][C_GT] = S_DONE_PI;
+        t.next[S_BANG][C_DQUOTE] = S_DECL_DQUOTE;
+        t.next[S_BANG][C_SQUOTE] = S_DECL_SQUOTE;
+        t.next[S_BANG_DASH][C_DASH] = S_COMMENT;
+        t.next[S_BANG_DASH][C_GT] = S_DONE_PI;
+
+        t.next[S_COMMENT][C_DASH] = S_COMMENT_DASH;
+        t.next[S_COMMENT_DASH][C_DASH] = S_COMMENT_DASHES;
+        t.next[S_COMMENT_DASHES][C_DASH] = S_COMMENT_DASHES;
+        t.next[S_COMMENT_DASHES][C_GT] = S_DONE_COMMENT;
+
+        t.next[S_PI][C_QUESTION] = S_PI_QUESTION;
+        t.next[S_PI_QUESTION][C_QUESTION] = S_PI_QUESTION;
+        t.next[S_PI_QUESTION][C_GT] = S_DONE_PI;
+
+        t.next[S_CDATA][C_RBRACKET] = S_CDATA_BRACKET;
+        t.next[S_CDATA_BRACKET][C_RBRACKET] = S_CDATA_BRACKETS;
+        t.next[S_CDATA_BRACKETS][C_RBRACKET] = S_CDATA_BRACKETS;
+        t.next[S_CDATA_BRACKETS][C_GT] = S_DONE_CDATA;
+
+        t.next[S_DECL][C_GT] = S_DONE_PI;
+        t.next[S_DECL][C_LBRACKET] = S_SUBSET;
+        t.next[S_DECL][C_DQUOTE] = S_DECL_DQUOTE;
+        t.next[S_DECL][C_SQUOTE] = S_DECL_SQUOTE;
+        t.next[S_DECL_DQUOTE][C_DQUOTE] = S_DECL;
+        t.next[S_DECL_SQUOTE][C_SQUOTE] = S_DECL;
+        t.next[S_SUBSET][C_RBRACKET] = S_DECL;
+        t.next[S_SUBSET][C_DQUOTE] = S_SUBSET_DQUOTE;
+        t.next[S_SUBSET][C_SQUOTE] = S_SUBSET_SQUOTE;
+        t.next[S_SUBSET_DQUOTE][C_DQUOTE] = S_SUBSET;
+        t.next[S_SUBSET_SQUOTE][C_SQUOTE] = S_SUBSET;
+
+        // Unfinished tokens (only read at the end of the input) keep the
+        // type of the construct they started
+        for (int state = 0; state < STATE_COUNT; ++state)
+            t.typeOf[state] = XmlTokenType::StartTag;
+        t.typeOf[S_END_TAG] = t.typeOf[S_DONE_END] = XmlTokenType::EndTag;
+        t.typeOf[S_DONE_SELF_CLOSING] = XmlTokenType::SelfClosingTag;
+        t.typeOf[S_COMMENT] = t.typeOf[S_COMMENT_DASH] = t.typeOf[S_COMMENT_DASHES] = XmlTokenType::Comment;
+        t.typeOf[S_DONE_COMMENT] = XmlTokenType::Comment;
+        t.typeOf[S_CDATA] = t.typeOf[S_CDATA_BRACKET] = t.typeOf[S_CDATA_BRACKETS] = XmlTokenType::CData;
+        t.typeOf[S_DONE_CDATA] = XmlTokenType::CData;
+        for (uint8_t state : {S_BANG, S_BANG_DASH, S_PI, S_PI_QUESTION, S_DECL, S_DECL_DQUOTE, S_DECL_SQUOTE,
+                              S_SUBSET, S_SUBSET_DQUOTE, S_SUBSET_SQUOTE, S_DONE_PI})
+            t.typeOf[state] = XmlTokenType::ProcessingInstruction;
+        return t;
+    }
+
+    constexpr LexTables LEX = buildLexTables();
+}
+
+string_view cdataContent(string_view raw)
+{
+    size_t start = raw.compare(0, 9, "<![CDATA[") == 0 ? 9 : 3;
+    size_t end = raw.size();
+    if (end >= start + 3 && raw.compare(end - 3, 3, "]]>") == 0)
+        end -= 3;
+    return start <= end ? raw.substr(start, end - start) : string_view();
+}
+
+bool scanXmlToken(string_view input, size_t &pos, bool atEnd, XmlToken &token,
+                  StructuralScanner *scanner)
+{
+    size_t n = input.size();
+    if (pos >= n)
+        return false;
+
+    const char *data = input.data();
+    token.offset = pos;
+    token.name = string_view();
+
+    // Character data runs up to the next '<'
+    if (data[pos] != '<')
+    {
+        size_t end = findOpen(input, pos, scanner);
+        if (end == n && !atEnd)
+            return false;
+        token.type = XmlTokenType::Text;
+        token.raw = input.substr(pos, end - pos);
+        pos = end;
+        return true;
+    }
+
+    // One table lookup per byte until an accepting state
+    uint8_t state = S_OPEN;
+    size_t end = pos + 1;
+    while (end < n)
+    {
+        state = LEX.next[state][LEX.classOf[static_cast<uint8_t>(data[end++])]];
+        if (state >= FIRST_DONE)
+            break;
+    }
+    // A token that runs into the end of a partial input may still continue
+    if (state < FIRST_DONE && !atEnd)
+        return false;
+
+    token.type = LEX.typeOf[state];
+    token.raw = input.substr(pos, end - pos);
+    pos = end;
+
+    if (token.type != XmlTokenType::StartTag && token.type != XmlTokenType::EndTag &&
+        token.type != XmlTokenType::SelfClosingTag)
+        return true;
+
+    // Tag name stops at whitespace, '/' or '>'
+    size_t nameStart = (token.type == XmlTokenType::EndTag) ? 2 : 1;
+    size_t nameEnd = nameStart;
+    while (nameEnd < token.raw.size() && !isXmlSpace(token.raw[nameEnd]) &&
+           token.raw[nameEnd] != '/' && token.raw[nameEnd] != '>')
+        ++nameEnd;
+    token.name = token.raw.substr(nameStart, nameEnd - nameStart);
+    return true;
+}
+
+XmlTokenizer::XmlTokenizer(string_view input) : input(input), pos(0), scanner(input) {}
+
+bool XmlTokenizer::next(XmlToken &token)
+{
+    return scanXmlToken(input, pos, true, token, &scanner);
+}
+
+XmlStreamTokenizer::XmlStreamTokenizer(istream &in, size_t chunkSize)
+    : in(in), buffer(chunkSize, '\0'), filled(0), pos(0), baseOffset(0), eof(false) {}
+
+bool XmlStreamTokenizer::next(XmlToken &token)
+{
+    while (true)
+    {
+        if (scanXmlToken(string_view(buffer.data(), filled), pos, eof, token))
+        {
+            token.offset += baseOffset;
+            return true;
+        }
+        if (eof)
+            return false;
+        refill();
+    }
+}
+
+void XmlStreamTokenizer::refill()
+{
+    // Keep the unfinished token and move it to the front of the buffer
+    if (pos > 0)
+    {
+        memmove(&buffer[0], buffer.data() + pos, filled - pos);
+        filled -= pos;
+        baseOffset += pos;
+        pos = 0;
+    }
+    // A single token larger than the buffer forces it to grow
+    if (filled == buffer.size())
+        buffer.resize(buffer.size() * 2);
+
+    in.read(&buffer[filled], buffer.size() - filled);
+    size_t got = static_cast<size_t>(in.gcount());
+    filled += got;
+    if (got == 0)
+        eof = true;
+}
@@ -0,0 +1,99 @@
+#ifndef XML_TOKENIZER_H
+#define XML_TOKENIZER_H
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StructuralScanner.h"
+
+using namespace std;
+
+// Chunk size used when reading and writing in streaming mode
+const size_t XML_STREAM_CHUNK_SIZE = 1 << 16;
+
+// Kinds of events produced while scanning an XML document
+enum class XmlTokenType
+{
+    StartTag,              // <name ...>
+    EndTag,                // </name>
+    SelfClosingTag,        // <name ... />
+    Text,                  // character data between tags
+    Comment,               // <!-- ... -->
+    ProcessingInstruction, // <? ... ?> and <! ... > declarations
+    CData,                 // <![CDATA[ ... ]]>, character data taken literally
+};
+
+// A single tokenizer event. Every view points into the tokenizer input,
+// so tokens are only valid as long as the input buffer is alive.
+struct XmlToken
+{
+    XmlTokenType type;
+    string_view raw;  // whole token, including '<' and '>' for markup
+    string_view name; // tag name for start, end and self-closing tags
+    size_t offset;    // byte offset of raw inside the input
+};
+
+// Character data inside a CDATA token, without its delimiters
+string_view cdataContent(string_view raw);
+
+// Scans one token starting at pos and advances pos past it.
+// Markup is read by a table-driven DFA, so '>' inside quoted attribute
+// values, comments, processing instructions, CDATA sections and DOCTYPE
+// internal subsets does not end the token.
+// When atEnd is false the input is only a prefix of the document, so a token
+// that may continue past the end is left unread and false is returned.
+// A scanner built over the same input replaces the memchr searches for '<' and '>'.
+bool scanXmlToken(string_view input, size_t &pos, bool atEnd, XmlToken &token,
+                  StructuralScanner *scanner = nullptr);
+
+// Event-based (pull) tokenizer shared by every XML command
+class XmlTokenizer
+{
+public:
+    explicit XmlTokenizer(string_view input);
+
+    // Reads the next token, returns false at the end of the input
+    bool next(XmlToken &token);
+
+private:
+    string_view input;
+    size_t pos;
+    StructuralScanner scanner;
+};
+
+// Tokenizer over a stream read in fixed-size chunks.
+// Memory stays bounded by the chunk size (or the largest single token):
+// an incomplete token at the end of a chunk is carried over to the next one.
+// Token views are invalidated by the following call to next().
+class XmlStreamTokenizer
+{
+public:
+    explicit XmlStreamTokenizer(istream &in, size_t chunkSize = XML_STREAM_CHUNK_SIZE);
+
+    bool next(XmlToken &token);
+
+private:
+    void refill();
+
+    istream &in;
+    string buffer;
+    size_t filled;     // bytes of buffer holding input
+    size_t pos;        // next unread byte in buffer
+    size_t baseOffset; // stream offset of buffer[0]
+    bool eof;
+};
+
+// Returns text without leading and trailing whitespace
+string_view trimWhitespace(string_view text);
+
+// Splits input into at most count ranges of about equal size for parallel
+// scans. Returns the range starts followed by input.size(). Every range
+// after the first starts at a '<', which is a token boundary unless it
+// falls inside a comment, CDATA section or attribute value; a scan of the
+// range before it then ends inside a token and can tell.
+vector<size_t> splitAtMarkup(string_view input, size_t count);
+
+#endif
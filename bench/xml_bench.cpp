@@ -0,0 +1,292 @@
+// Benchmarks every xml_editor command on NetworkGenerator inputs.
+//
+//   g++ -std=c++17 -O2 -pthread bench/xml_bench.cpp -o xml_bench
+//   ./xml_bench [--sizes 1M,16M,128M] [--commands verify,format,...]
+//               [--repeat 3] [--threads n] [--timeout 120] [--dir /tmp]
+//               [--keep] [-o results.json]
+//
+// Every run is a forked child calling the same runCommand as the editor,
+// so its wall time includes loading the input and its peak RSS is its own.
+// Results go to stdout (or -o) as one JSON document; progress goes to
+// stderr. Sizes take K, M and G suffixes (powers of 1024) and go up to
+// whatever the disk holds, 10G included. POSIX only.
+
+#define XML_EDITOR_NO_MAIN
+#include "../xml_editor.cpp"
+#include "../NetworkGenerator.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    struct BenchOptions
+    {
+        vector<size_t> sizes = {1 << 20, 16 << 20, 128 << 20};
+        vector<string> commands = {"verify", "format", "mini", "json", "compress", "decompress",
+                                   "most_active", "most_influencer", "mutual", "suggest", "search"};
+        unsigned repeat = 3;
+        unsigned threads = 1;
+        unsigned timeout = 120; // seconds per run
+        string directory = "/tmp";
+        bool keep = false;
+        string outputFile;
+    };
+
+    struct RunResult
+    {
+        double seconds = 0;
+        long peakRssKb = 0;
+        int exitCode = 0;
+        bool timedOut = false;
+    };
+
+    struct BenchResult
+    {
+        string command;
+        size_t inputBytes;
+        vector<RunResult> runs;
+    };
+
+    string sizeLabel(size_t bytes)
+    {
+        if (bytes >= (1ull << 30) && bytes % (1ull << 30) == 0)
+            return to_string(bytes >> 30) + "G";
+        if (bytes >= (1 << 20) && bytes % (1 << 20) == 0)
+            return to_string(bytes >> 20) + "M";
+        return to_string(bytes);
+    }
+
+    // Writes users until the file reaches about bytes, the same on every run
+    bool writeNetwork(const string &path, size_t bytes, string &searchTerm)
+    {
+        NetworkGeneratorOptions options;
+        options.seed = 42;
+        options.targetBytes = bytes;
+        NetworkGenerator generator(options);
+        searchTerm = generator.word(0);
+
+        OutputBuffer out;
+        return out.openFile(path) && generator.write(out) && out.close();
+    }
+
+    CommandOptions commandOptions(const string &command, const string &input, const string &output, unsigned threads,
+                                  const string &searchTerm)
+    {
+        CommandOptions options;
+        options.command = command;
+        options.inputFile = input;
+        options.outputFile = output;
+        options.threads = threads;
+        if (command == "mutual")
+            options.userIds = {"1", "2"};
+        else if (command == "suggest")
+            options.userId = "1";
+        else if (command == "search")
+        {
+            options.searchType = "word";
+            options.searchTerm = searchTerm;
+        }
+        return options;
+    }
+
+    // Runs one command in a child process and waits for it
+    RunResult runOnce(const CommandOptions &options, unsigned timeout)
+    {
+        RunResult result;
+        auto started = chrono::steady_clock::now();
+        pid_t child = fork();
+        if (child == 0)
+        {
+            // Commands report through cout and cerr; the bench only wants their cost
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            alarm(timeout);
+
+            InputCache cache;
+            int status = runCommand(options, cache);
+            cout.flush();
+            _exit(status);
+        }
+        if (child < 0)
+        {
+            result.exitCode = -1;
+            return result;
+        }
+
+        int status = 0;
+        struct rusage usage;
+        wait4(child, &status, 0, &usage);
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+#ifdef __APPLE__
+        result.peakRssKb = usage.ru_maxrss / 1024;
+#else
+        result.peakRssKb = usage.ru_maxrss;
+#endif
+        if (WIFSIGNALED(status))
+        {
+            result.timedOut = WTERMSIG(status) == SIGALRM;
+            result.exitCode = 128 + WTERMSIG(status);
+        }
+        else
+        {
+            result.exitCode = WEXITSTATUS(status);
+        }
+        return result;
+    }
+
+    void appendResult(string &json, const BenchResult &result)
+    {
+        vector<double> times;
+        long peakRss = 0;
+        int exitCode = 0;
+        bool timedOut = false;
+        for (const RunResult &run : result.runs)
+        {
+            times.push_back(run.seconds);
+            peakRss = max(peakRss, run.peakRssKb);
+            exitCode = exitCode ? exitCode : run.exitCode;
+            timedOut = timedOut || run.timedOut;
+        }
+        sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        double megabytes = result.inputBytes / (1024.0 * 1024.0);
+
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+                 "    {\"command\": \"%s\", \"input_bytes\": %zu, \"runs\": %zu, \"exit_code\": %d, \"timed_out\": %s, "
+                 "\"latency_ms\": {\"min\": %.3f, \"median\": %.3f, \"max\": %.3f}, "
+                 "\"throughput_mb_s\": %.2f, \"peak_rss_kb\": %ld}",
+                 result.command.c_str(), result.inputBytes, result.runs.size(), exitCode, timedOut ? "true" : "false",
+                 times.front() * 1000, median * 1000, times.back() * 1000, median > 0 ? megabytes / median : 0.0,
+                 peakRss);
+        json += buffer;
+    }
+
+    bool parseArguments(int argc, char *argv[], BenchOptions &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--sizes" && hasValue)
+            {
+                options.sizes.clear();
+                for (const string &size : splitString(argv[++i], ','))
+                    options.sizes.push_back(parseByteSize(size));
+            }
+            else if (arg == "--commands" && hasValue)
+                options.commands = splitString(argv[++i], ',');
+            else if (arg == "--repeat" && hasValue)
+                options.repeat = max(1, atoi(argv[++i]));
+            else if (arg == "--threads" && hasValue)
+                options.threads = max(1, atoi(argv[++i]));
+            else if (arg == "--timeout" && hasValue)
+                options.timeout = max(1, atoi(argv[++i]));
+            else if (arg == "--dir" && hasValue)
+                options.directory = argv[++i];
+            else if (arg == "--keep")
+                options.keep = true;
+            else if (arg == "-o" && hasValue)
+                options.outputFile = argv[++i];
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    if (!parseArguments(argc, argv, options))
+    {
+        cerr << "Usage: xml_bench [--sizes 1M,16M,128M] [--commands verify,format,...] [--repeat n]\n";
+        cerr << "                 [--threads n] [--timeout seconds] [--dir path] [--keep] [-o results.json]\n";
+        return 1;
+    }
+
+    string prefix = options.directory + "/xml_bench_" + to_string(getpid());
+    vector<BenchResult> results;
+
+    for (size_t size : options.sizes)
+    {
+        string input = prefix + "_" + sizeLabel(size) + ".xml";
+        string output = prefix + "_" + sizeLabel(size) + ".out";
+        string compressed = prefix + "_" + sizeLabel(size) + ".huff";
+
+        cerr << "Generating " << input << "\n";
+        string searchTerm;
+        if (!writeNetwork(input, size, searchTerm))
+        {
+            cerr << "Error: cannot write " << input << "\n";
+            return 1;
+        }
+        struct stat info;
+        size_t inputBytes = stat(input.c_str(), &info) == 0 ? size_t(info.st_size) : size;
+
+        for (const string &command : options.commands)
+        {
+            // decompress reads what compress wrote, and its own output is the xml
+            CommandOptions run = commandOptions(command, input, output, options.threads, searchTerm);
+            if (command == "compress")
+                run.outputFile = compressed;
+            else if (command == "decompress")
+                run.inputFile = compressed;
+
+            BenchResult result{command, inputBytes, {}};
+            for (unsigned i = 0; i < options.repeat; ++i)
+            {
+                result.runs.push_back(runOnce(run, options.timeout));
+                if (result.runs.back().timedOut)
+                    break;
+            }
+
+            const RunResult &last = result.runs.back();
+            cerr << "  " << command << " " << sizeLabel(size) << ": " << last.seconds * 1000 << " ms, "
+                 << last.peakRssKb << " KB peak" << (last.timedOut ? " (timed out)" : "")
+                 << (last.exitCode && !last.timedOut ? " (exit " + to_string(last.exitCode) + ")" : "") << "\n";
+            results.push_back(move(result));
+        }
+
+        if (!options.keep)
+        {
+            remove(input.c_str());
+            remove(output.c_str());
+            remove(compressed.c_str());
+        }
+    }
+
+    string json = "{\n  \"threads\": " + to_string(options.threads) + ",\n  \"hardware_threads\": " +
+                  to_string(thread::hardware_concurrency()) + ",\n  \"structural_kernel\": \"" +
+                  structuralKernelName() + "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        appendResult(json, results[i]);
+        json += i + 1 < results.size() ? ",\n" : "\n";
+    }
+    json += "  ]\n}\n";
+
+    if (options.outputFile.empty())
+    {
+        cout << json;
+        return 0;
+    }
+    OutputBuffer out;
+    if (!out.openFile(options.outputFile))
+    {
+        cerr << "Error: cannot write " << options.outputFile << "\n";
+        return 1;
+    }
+    out.write(json);
+    return out.close() ? 0 : 1;
+}
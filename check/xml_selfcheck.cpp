@@ -0,0 +1,854 @@
+// Checks the hand-written fast paths of the editor against plain versions
+// of the same logic, on seeded random inputs.
+//
+//   g++ -std=c++17 -O2 -pthread check/xml_selfcheck.cpp -o xml_selfcheck
+//   ./xml_selfcheck [--seed n] [--rounds n]
+//
+// Each SIMD kernel the CPU supports is compared with the scalar kernel it
+// replaces, the markup DFA with a lexer written out case by case, the JSON
+// escaper with a walk over the text one unit at a time, and the incremental
+// and parallel verifiers with the sequential verifyXML, whose errors the
+// repair has to fix. The minifier is checked to drop only whitespace, and
+// all the layout format adds. JSON runs decided by reading ahead are checked
+// against runs held to the end, and CBOR against the text.
+// Prints one line per check and exits with 1 if any failed.
+
+#define XML_EDITOR_NO_MAIN
+#include "../xml_editor.cpp"
+#include "../NetworkGenerator.cpp"
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    struct CheckOptions
+    {
+        uint64_t seed = 1;
+        size_t rounds = 2000;
+    };
+
+    // Counts failures of one check and keeps the first message
+    class CheckResult
+    {
+    public:
+        explicit CheckResult(const string &name) : name(name), failures(0) {}
+
+        void fail(const string &message)
+        {
+            if (failures++ == 0)
+                first = message;
+        }
+        bool report() const
+        {
+            if (failures == 0)
+                cout << "ok    " << name << "\n";
+            else
+                cout << "FAIL  " << name << ": " << failures << " failures, first: " << first << "\n";
+            return failures == 0;
+        }
+
+    private:
+        string name;
+        size_t failures;
+        string first;
+    };
+
+    // Printable form of a test input for failure messages
+    string printable(string_view text)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+        string result = "\"";
+        for (char c : text.substr(0, 200))
+        {
+            uint8_t byte = static_cast<uint8_t>(c);
+            if (byte >= 0x20 && byte < 0x7F && c != '"' && c != '\\')
+            {
+                result += c;
+            }
+            else
+            {
+                result += "\\x";
+                result += hexDigits[byte >> 4];
+                result += hexDigits[byte & 0xF];
+            }
+        }
+        return result + (text.size() > 200 ? "\"..." : "\"");
+    }
+
+    // Text made of pieces picked at random, so that the delimiters the
+    // fast paths look for come up often and next to each other
+    string randomText(SplitMix64 &random, const vector<string> &pieces, size_t count)
+    {
+        string text;
+        for (size_t i = 0; i < count; ++i)
+            text += pieces[random.below(pieces.size())];
+        return text;
+    }
+
+    // Byte masks: every kernel against the scalar one, for the bytes the
+    // scanner and the line index look for
+
+    bool checkByteMasks(const CheckOptions &options)
+    {
+        CheckResult result("byte mask kernels");
+        SplitMix64 random(options.seed);
+        const vector<string> pieces = {"<", ">", "/", "\"", "a", " ", "\n", "\r\n", "\xC3\xA9", "\x80", "\xFF", "<<"};
+
+        for (size_t round = 0; round < options.rounds; ++round)
+        {
+            string block = randomText(random, pieces, STRUCTURAL_BLOCK_SIZE);
+            block.resize(STRUCTURAL_BLOCK_SIZE);
+            for (char ch : {'<', '\n', '\xFF'})
+            {
+                uint64_t expected = byteMaskScalar(block.data(), ch);
+#ifdef XML_SIMD_X86
+                if (simdLevel() >= SimdLevel::Sse2 && byteMaskSse2(block.data(), ch) != expected)
+                    result.fail("sse2 on " + printable(block));
+                if (simdLevel() >= SimdLevel::Avx2 && byteMaskAvx2(block.data(), ch) != expected)
+                    result.fail("avx2 on " + printable(block));
+#endif
+            }
+        }
+        return result.report();
+    }
+
+    // Markup DFA: tokens against a lexer written out case by case
+
+    struct ReferenceToken
+    {
+        XmlTokenType type;
+        size_t end;
+    };
+
+    // End of the first occurrence of delimiter at or after from, or size
+    size_t endOf(string_view input, string_view delimiter, size_t from)
+    {
+        size_t found = input.find(delimiter, from);
+        return found == string_view::npos ? input.size() : found + delimiter.size();
+    }
+
+    // Declaration body from pos: quoted strings and a [...] subset, with
+    // its own quoted strings, hide '>'
+    size_t declarationEnd(string_view input, size_t pos, char quote)
+    {
+        bool subset = false;
+        for (; pos < input.size(); ++pos)
+        {
+            char c = input[pos];
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            else if (subset)
+            {
+                subset = c != ']';
+            }
+            else if (c == '[')
+            {
+                subset = true;
+            }
+            else if (c == '>')
+            {
+                return pos + 1;
+            }
+        }
+        return input.size();
+    }
+
+    // Markup token at pos, which holds '<'
+    ReferenceToken referenceMarkup(string_view input, size_t pos)
+    {
+        size_t n = input.size();
+        auto at = [&](size_t i) { return i < n ? input[i] : '\0'; };
+        if (pos + 1 >= n)
+            return {XmlTokenType::StartTag, n};
+
+        char first = input[pos + 1];
+        if (first == '/')
+            return {XmlTokenType::EndTag, endOf(input, ">", pos + 2)};
+        if (first == '?')
+            return {XmlTokenType::ProcessingInstruction, endOf(input, "?>", pos + 2)};
+        if (first == '!')
+        {
+            char second = at(pos + 2);
+            if (pos + 2 >= n)
+                return {XmlTokenType::ProcessingInstruction, n};
+            if (second == '[')
+                return {XmlTokenType::CData, endOf(input, "]]>", pos + 3)};
+            if (second == '>')
+                return {XmlTokenType::ProcessingInstruction, pos + 3};
+            if (second == '"' || second == '\'')
+                return {XmlTokenType::ProcessingInstruction, declarationEnd(input, pos + 3, second)};
+            if (second != '-')
+                return {XmlTokenType::ProcessingInstruction, declarationEnd(input, pos + 3, 0)};
+            // "<!-": a comment only with a second dash
+            if (pos + 3 >= n)
+                return {XmlTokenType::ProcessingInstruction, n};
+            if (input[pos + 3] == '-')
+                return {XmlTokenType::Comment, endOf(input, "-->", pos + 4)};
+            if (input[pos + 3] == '>')
+                return {XmlTokenType::ProcessingInstruction, pos + 4};
+            return {XmlTokenType::ProcessingInstruction, declarationEnd(input, pos + 4, 0)};
+        }
+
+        // Start tag: quoted values hide '>', and "/>" outside them closes it
+        char quote = 0;
+        bool slash = false;
+        for (size_t i = pos + 1; i < n; ++i)
+        {
+            char c = input[i];
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+                continue;
+            }
+            if (c == '>')
+                return {slash ? XmlTokenType::SelfClosingTag : XmlTokenType::StartTag, i + 1};
+            if (c == '"' || c == '\'')
+                quote = c;
+            slash = c == '/' && i > pos + 1;
+        }
+        return {XmlTokenType::StartTag, n};
+    }
+
+    string_view referenceName(string_view raw, XmlTokenType type)
+    {
+        if (type != XmlTokenType::StartTag && type != XmlTokenType::EndTag && type != XmlTokenType::SelfClosingTag)
+            return string_view();
+        size_t start = type == XmlTokenType::EndTag ? 2 : 1;
+        size_t end = start;
+        while (end < raw.size() && raw[end] != ' ' && raw[end] != '\t' && raw[end] != '\n' && raw[end] != '\r' &&
+               raw[end] != '/' && raw[end] != '>')
+            ++end;
+        return raw.substr(min(start, raw.size()), end - min(start, raw.size()));
+    }
+
+    string describe(const XmlToken &token)
+    {
+        return to_string(int(token.type)) + "@" + to_string(token.offset) + " " + printable(token.raw);
+    }
+
+    bool checkTokenizer(const CheckOptions &options)
+    {
+        CheckResult lexer("markup DFA against reference lexer");
+        CheckResult scanned("tokenizer with and without scanner");
+        CheckResult streamed("stream tokenizer across chunk ends");
+        SplitMix64 random(options.seed + 1);
+        const vector<string> pieces = {"<", ">", "/", "/>", "</", "\"", "'", "-", "--", "-->", "<!--", "<!", "!",
+                                       "<![CDATA[", "]", "]]>", "<?", "?", "?>", "<!DOCTYPE", "[", " ", "a",
+                                       "bc", "\n"};
+
+        for (size_t round = 0; round < options.rounds; ++round)
+        {
+            string input = randomText(random, pieces, 1 + random.below(60));
+            string_view view(input);
+
+            vector<XmlToken> tokens;
+            XmlTokenizer tokenizer(view);
+            XmlToken token;
+            while (tokenizer.next(token))
+                tokens.push_back(token);
+
+            // Every token against the reference, and the tokens tile the input
+            size_t pos = 0;
+            for (const XmlToken &got : tokens)
+            {
+                XmlTokenType type = XmlTokenType::Text;
+                size_t end = view.find('<', pos);
+                if (end == string_view::npos)
+                    end = view.size();
+                if (view[pos] == '<')
+                {
+                    ReferenceToken expected = referenceMarkup(view, pos);
+                    type = expected.type;
+                    end = expected.end;
+                }
+                string_view raw = view.substr(pos, end - pos);
+                if (got.offset != pos || got.type != type || got.raw != raw ||
+                    got.name != referenceName(raw, type))
+                {
+                    lexer.fail(describe(got) + ", expected " + to_string(int(type)) + "@" + to_string(pos) + " " +
+                               printable(raw) + " in " + printable(input));
+                    break;
+                }
+                pos = end;
+            }
+            if (pos != view.size() && tokens.size() > 0)
+                lexer.fail("tokens stop at " + to_string(pos) + " in " + printable(input));
+
+            // The memchr path finds the same tokens as the scanner
+            size_t plainPos = 0;
+            size_t index = 0;
+            while (scanXmlToken(view, plainPos, true, token))
+            {
+                if (index >= tokens.size() || token.raw.data() != tokens[index].raw.data() ||
+                    token.raw.size() != tokens[index].raw.size() || token.type != tokens[index].type)
+                {
+                    scanned.fail("token " + to_string(index) + " in " + printable(input));
+                    break;
+                }
+                ++index;
+            }
+            if (index != tokens.size())
+                scanned.fail("token count in " + printable(input));
+
+            // Small chunks leave most tokens unfinished at a chunk end
+            istringstream stream(input);
+            XmlStreamTokenizer chunked(stream, 1 + random.below(8));
+            index = 0;
+            while (chunked.next(token))
+            {
+                if (index >= tokens.size() || token.offset != tokens[index].offset || token.raw != tokens[index].raw ||
+                    token.type != tokens[index].type || token.name != tokens[index].name)
+                {
+                    streamed.fail("token " + to_string(index) + " in " + printable(input));
+                    break;
+                }
+                ++index;
+            }
+            if (index != tokens.size())
+                streamed.fail("token count in " + printable(input));
+        }
+
+        bool ok = lexer.report();
+        ok = scanned.report() && ok;
+        return streamed.report() && ok;
+    }
+
+    // JSON escaping: window classes of every kernel against the scalar
+    // one, and whole strings against a walk one unit at a time
+
+    const vector<string> ESCAPE_PIECES = {
+        "a", " ", "\"", "\\", "\n", "\x01", "\x7F", "&amp;", "&lt;", "&quot;", "&#x1F600;", "&#233;", "&#0;",
+        "&#xD800;", "&#x110000;", "&#99999999999;", "&bogus;", "&", "&#", "&#x;", "\xC3\xA9", "\xE2\x82\xAC",
+        "\xF0\x9F\x98\x80", "\x80", "\xBF", "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xED\xA0\x80",
+        "\xC0\xAF", "\xE0\x80\xAF", "\xF4\x90\x80\x80", "\xF5", "\xFF", "abcdefghijklmnopqrstuvwxyz0123456789"};
+
+    // Whether a window holds invalid UTF-8, counting the bytes before it
+    // as ASCII and a sequence cut by its end as valid
+    bool referenceWindowInvalid(const char *window)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(window);
+        size_t pos = 0;
+        while (pos < JSON_ESCAPE_WINDOW)
+        {
+            size_t invalidLength = 0;
+            size_t length = utf8SequenceLength(data + pos, JSON_ESCAPE_WINDOW - pos, invalidLength);
+            if (length > 0)
+            {
+                pos += length;
+                continue;
+            }
+            // A lead byte in the last position is left to the next window,
+            // whatever its value, since nothing after it can be checked
+            bool lead = data[pos] >= 0xC2 && data[pos] <= 0xF4;
+            bool cut = (lead && pos + invalidLength == JSON_ESCAPE_WINDOW) || (pos == JSON_ESCAPE_WINDOW - 1 && data[pos] >= 0xC0);
+            return !cut;
+        }
+        return false;
+    }
+
+    // escapeJsonString without the kernels: every unit is looked at
+    string referenceEscape(string_view text, bool decodeEntities, bool escape)
+    {
+        string result(JSON_ESCAPE_GROWTH * text.size(), '\0');
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(text.data());
+        char *out = &result[0];
+        size_t pos = 0;
+        while (pos < text.size())
+        {
+            size_t clean = cleanLength(data + pos, text.size() - pos, decodeEntities);
+            if (clean > 0)
+            {
+                memcpy(out, text.data() + pos, clean);
+                out += clean;
+                pos += clean;
+                continue;
+            }
+            uint32_t codePoint;
+            size_t length;
+            if (data[pos] >= 0x80)
+            {
+                size_t invalidLength = 1;
+                utf8SequenceLength(data + pos, text.size() - pos, invalidLength);
+                out = writeCodePoint(0xFFFD, out, escape);
+                pos += invalidLength;
+            }
+            else if (data[pos] == '&' && (length = decodeEntity(text.data() + pos, text.size() - pos, codePoint)) > 0)
+            {
+                out = writeCodePoint(codePoint, out, escape);
+                pos += length;
+            }
+            else
+            {
+                if (escape)
+                    out = writeAscii(char(data[pos]), out);
+                else
+                    *out++ = char(data[pos]);
+                ++pos;
+            }
+        }
+        result.resize(out - &result[0]);
+        return result;
+    }
+
+    size_t referenceCleanPrefix(string_view text, bool decodeEntities)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(text.data());
+        size_t pos = 0, clean;
+        while (pos < text.size() && (clean = cleanLength(data + pos, text.size() - pos, decodeEntities)) > 0)
+            pos += clean;
+        return pos;
+    }
+
+    bool checkEscapeKernels(const CheckOptions &options)
+    {
+        CheckResult windows("JSON escape window kernels");
+        CheckResult strings("JSON escaping against unit walk");
+
+        vector<EscapeDispatch> kernels = {{classifyScalar, "scalar"}};
+#ifdef XML_SIMD_X86
+        if (simdLevel() >= SimdLevel::Sse2)
+            kernels.push_back({classifySse2, "sse2"});
+        if (simdLevel() >= SimdLevel::Avx2)
+            kernels.push_back({classifyAvx2, "avx2"});
+#endif
+        EscapeDispatch selected = escapeDispatch();
+
+        SplitMix64 random(options.seed + 2);
+        for (size_t round = 0; round < options.rounds; ++round)
+        {
+            string window = randomText(random, ESCAPE_PIECES, JSON_ESCAPE_WINDOW);
+            window.resize(JSON_ESCAPE_WINDOW);
+            bool invalid = referenceWindowInvalid(window.data());
+            for (bool decodeEntities : {false, true})
+            {
+                EscapeWindow expected = classifyScalar(window.data(), decodeEntities);
+                for (const EscapeDispatch &kernel : kernels)
+                {
+                    EscapeWindow got = kernel.classify(window.data(), decodeEntities);
+                    // Only AVX2 validates; the others send every non-ASCII window to the walk
+                    bool exact = string(kernel.name) == "avx2";
+                    if (got.special != expected.special || got.nonAscii != expected.nonAscii ||
+                        (exact ? got.invalid != invalid : got.invalid != (got.nonAscii != 0)))
+                        windows.fail(string(kernel.name) + " on " + printable(window));
+                }
+            }
+
+            string text = randomText(random, ESCAPE_PIECES, random.below(40));
+            for (bool decodeEntities : {false, true})
+            {
+                string escaped = referenceEscape(text, decodeEntities, true);
+                string decoded = referenceEscape(text, decodeEntities, false);
+                size_t clean = referenceCleanPrefix(text, decodeEntities);
+                string output(JSON_ESCAPE_GROWTH * text.size(), '\0');
+                for (const EscapeDispatch &kernel : kernels)
+                {
+                    escapeDispatch() = kernel;
+                    string where = string(kernel.name) + (decodeEntities ? " with entities" : "") + " on " + printable(text);
+                    if (jsonCleanPrefix(text, decodeEntities) != clean)
+                        strings.fail("clean prefix, " + where);
+                    if (string_view(output.data(), escapeJsonString(text, &output[0], decodeEntities)) != escaped)
+                        strings.fail("escaped, " + where);
+                    if (string_view(output.data(), decodeXmlText(text, &output[0], decodeEntities)) != decoded)
+                        strings.fail("decoded, " + where);
+                }
+            }
+        }
+        escapeDispatch() = selected;
+
+        bool ok = windows.report();
+        return strings.report() && ok;
+    }
+
+    // Minifier: layout whitespace goes, everything else stays
+
+    string withoutWhitespace(string_view text)
+    {
+        string result;
+        for (char c : text)
+        {
+            if (!isXmlSpace(c))
+                result += c;
+        }
+        return result;
+    }
+
+    bool checkMinifier(const CheckOptions &options)
+    {
+        CheckResult minified("minifier drops layout only");
+        SplitMix64 random(options.seed + 5);
+        const vector<string> pieces = {"<p>", "</p>", "<b>", "</b>", "<br/>", "word", "two words", " ", "  ",
+                                       "\n", "\n    ", "\t", "<!-- c -->", "<![CDATA[ x ]]>", "<?pi?>"};
+
+        for (size_t round = 0; round < options.rounds / 10; ++round)
+        {
+            string input;
+            if (round % 4 == 0)
+            {
+                NetworkGeneratorOptions network;
+                network.seed = options.seed + round;
+                network.users = 1 + random.below(8);
+                network.noise = 0.5;
+                network.defects = 0.1;
+                OutputBuffer out(input);
+                NetworkGenerator(network).write(out);
+                out.close();
+            }
+            else
+            {
+                input = randomText(random, pieces, random.below(60));
+            }
+
+            string mini = MinifyingFunction(input);
+            string formattedMini = MinifyingFunction(FormattingFunction(input));
+            ostringstream streamed;
+            istringstream in(input);
+            MinifyingStream(in, streamed);
+
+            if (withoutWhitespace(mini) != withoutWhitespace(input))
+                minified.fail("content changed in " + printable(input));
+            else if (MinifyingFunction(mini) != mini)
+                minified.fail("minifying twice changed " + printable(input));
+            else if (streamed.str() != mini)
+                minified.fail("stream differs on " + printable(input));
+            for (size_t pos = formattedMini.find('\n'); pos != string::npos; pos = formattedMini.find('\n', pos + 1))
+            {
+                if (pos + 1 < formattedMini.size() && (formattedMini[pos + 1] == ' ' || formattedMini[pos + 1] == '\t'))
+                {
+                    minified.fail("indented line left in mini(format(" + printable(input) + "))");
+                    break;
+                }
+            }
+        }
+        return minified.report();
+    }
+
+    // JSON: held runs decided by reading ahead as when held to the end, the
+    // stream as the mapped input, and CBOR with the containers of the text
+
+    // Containers and strings of the JSON text, such as "{1s[2ss]}"
+    string jsonShape(string_view json, size_t &pos)
+    {
+        while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == ',' || json[pos] == ':'))
+            ++pos;
+        if (pos == json.size())
+            return "?";
+        char open = json[pos++];
+        if (open == '"')
+        {
+            while (pos < json.size() && json[pos] != '"')
+                pos += json[pos] == '\\' ? 2 : 1;
+            ++pos;
+            return "s";
+        }
+        char close = open == '{' ? '}' : ']';
+        string items;
+        size_t count = 0;
+        while (true)
+        {
+            while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == ','))
+                ++pos;
+            if (pos == json.size() || json[pos] == close)
+                break;
+            items += jsonShape(json, pos);
+            if (open == '{')
+                items += jsonShape(json, pos);
+            ++count;
+        }
+        ++pos;
+        return open + to_string(count) + items + close;
+    }
+
+    // The same for CBOR
+    string cborShape(string_view cbor, size_t &pos)
+    {
+        if (pos == cbor.size())
+            return "?";
+        uint8_t head = static_cast<uint8_t>(cbor[pos++]);
+        uint64_t size = head & 31;
+        if (size >= 24)
+        {
+            size_t bytes = size_t(1) << (size - 24);
+            size = 0;
+            for (size_t i = 0; i < bytes && pos < cbor.size(); ++i)
+                size = size << 8 | static_cast<uint8_t>(cbor[pos++]);
+        }
+        switch (head >> 5)
+        {
+        case 3:
+            pos += size;
+            return "s";
+        case 4:
+        case 5:
+        {
+            bool isMap = head >> 5 == 5;
+            string items;
+            for (uint64_t i = 0; i < size; ++i)
+            {
+                items += cborShape(cbor, pos);
+                if (isMap)
+                    items += cborShape(cbor, pos);
+            }
+            return (isMap ? "{" : "[") + to_string(size) + items + (isMap ? "}" : "]");
+        }
+        default:
+            return "?";
+        }
+    }
+
+    bool checkJsonGrouping(const CheckOptions &options)
+    {
+        CheckResult grouping("JSON grouping paths agree");
+        SplitMix64 random(options.seed + 6);
+        const vector<string> pieces = {"<a>", "</a>", "<a>", "</a>", "<b>", "</b>", "<c/>", "<a/>", "text", " "};
+        const vector<vector<string>> arrayTagSets = {{}, {"a"}, {"b", "c"}};
+
+        for (size_t round = 0; round < options.rounds / 10; ++round)
+        {
+            string input;
+            if (round % 4 == 0)
+            {
+                NetworkGeneratorOptions network;
+                network.seed = options.seed + round;
+                network.users = 1 + random.below(4);
+                network.noise = 0.3;
+                network.defects = 0.05;
+                OutputBuffer out(input);
+                NetworkGenerator(network).write(out);
+                out.close();
+            }
+            else
+            {
+                input = randomText(random, pieces, random.below(60));
+            }
+
+            for (const vector<string> &arrayTags : arrayTagSets)
+            {
+                JsonOptions json;
+                json.arrayTags = arrayTags;
+                string held = XmlToJsonConverter(json).convertToJson(input);
+
+                json.heldLimit = random.below(64);
+                string readAhead = XmlToJsonConverter(json).convertToJson(input);
+
+                ostringstream streamed;
+                istringstream in(input);
+                XmlToJsonConverter(json).convertStream(in, streamed);
+
+                json.format = JsonFormat::Cbor;
+                string cbor;
+                {
+                    OutputBuffer out(cbor);
+                    XmlToJsonConverter(json).convertToJson(input, out);
+                    out.flush();
+                }
+                size_t textPos = 0, cborPos = 0;
+                string textShape = jsonShape(held, textPos), binaryShape = cborShape(cbor, cborPos);
+
+                string where = printable(input) + " with " + to_string(arrayTags.size()) + " array tags";
+                if (readAhead != held)
+                    grouping.fail("read-ahead differs on " + where);
+                else if (streamed.str() != held)
+                    grouping.fail("stream differs on " + where);
+                else if (binaryShape != textShape)
+                    grouping.fail("CBOR " + binaryShape + " instead of " + textShape + " on " + where);
+            }
+        }
+
+        // Listing a tag keeps the other runs grouped
+        JsonOptions json;
+        json.arrayTags = {"b"};
+        string listed = XmlToJsonConverter(json).convertToJson("<r><a>1</a><a>2</a><b>3</b></r>");
+        if (listed.find("\"a\": [\"1\", \"2\"]") == string::npos || listed.find("\"b\": [\"3\"]") == string::npos)
+            grouping.fail("listed tags as " + printable(listed));
+        return grouping.report();
+    }
+
+    // Verifiers: the incremental and parallel ones against the sequential
+    // verifyXML on the same text
+
+    string describeErrors(const vector<TagError> &errors)
+    {
+        string text;
+        for (const TagError &error : errors)
+            text += " " + to_string(error.offset) + "@" + to_string(error.line) + ":" + to_string(error.column);
+        return text.empty() ? " none" : text;
+    }
+
+    bool sameErrors(const vector<TagError> &left, const vector<TagError> &right)
+    {
+        if (left.size() != right.size())
+            return false;
+        for (size_t i = 0; i < left.size(); ++i)
+        {
+            if (left[i].offset != right[i].offset || left[i].line != right[i].line || left[i].column != right[i].column)
+                return false;
+        }
+        return true;
+    }
+
+    bool checkIncrementalVerifier(const CheckOptions &options)
+    {
+        CheckResult incremental("incremental verifier under edits");
+        SplitMix64 random(options.seed + 3);
+        const vector<string> pieces = {"<a>", "</a>", "<b x=\"1\">", "</b>", "<c/>", "<d>", "</d>", "text", " ",
+                                       "\n", "<!-- <a> -->", "<![CDATA[</b>]]>", "<?pi <d>?>", "<", ">", "/"};
+
+        for (size_t round = 0; round < options.rounds / 10; ++round)
+        {
+            string text = randomText(random, pieces, random.below(200));
+            // Small chunks, so edits cross chunk ends and reshape the tree
+            IncrementalVerifier verifier(text, 16 + random.below(64));
+
+            for (size_t edit = 0; edit < 10; ++edit)
+            {
+                size_t offset = random.below(text.size() + 1);
+                size_t length = min(random.below(24), text.size() - offset);
+                string replacement = randomText(random, pieces, random.below(4));
+                // Overwriting one byte mostly keeps the chunk count, which
+                // takes the path that updates leaves in place
+                if (random.below(2) && offset < text.size())
+                {
+                    length = 1;
+                    replacement = string(1, "ab<>/ \n"[random.below(7)]);
+                }
+                string before = text;
+                text.replace(offset, length, replacement);
+                verifier.applyEdit(offset, length, replacement);
+
+                string where = "replacing " + to_string(length) + " bytes at " + to_string(offset) + " of " +
+                               printable(before) + " with " + printable(replacement);
+                VerifyResult expected = verifyXML(text, VerifyOptions());
+                vector<TagError> errors = verifier.errors();
+                if (verifier.text() != text)
+                    incremental.fail("text after " + where);
+                else if (verifier.isValid() != expected.valid || !sameErrors(errors, expected.errors))
+                    incremental.fail("errors" + describeErrors(errors) + " instead of" + describeErrors(expected.errors) +
+                                     " after " + where);
+            }
+        }
+        return incremental.report();
+    }
+
+    bool checkRepair(const CheckOptions &options)
+    {
+        CheckResult repair("repair makes documents valid");
+        SplitMix64 random(options.seed + 4);
+        const vector<string> pieces = {"<a>", "</a>", "<b>", "</b>", "<c/>", "<d x=\"1\">", "</d>", "text", "\n",
+                                       "<!-- </a> -->"};
+
+        for (size_t round = 0; round < options.rounds; ++round)
+        {
+            string text = randomText(random, pieces, random.below(40));
+            VerifyResult before = verifyXML(text, VerifyOptions());
+            // Every invalid document has an error to show, as with --fail-fast
+            if (!before.valid && before.errorCount == 0)
+            {
+                repair.fail("invalid with no error: " + printable(text));
+                continue;
+            }
+
+            vector<RepairEdit> edits = planTagRepairs(text);
+            string repaired;
+            writeRepaired(text, edits, repaired);
+            if (before.valid != edits.empty())
+                repair.fail(to_string(edits.size()) + " edits for " + printable(text));
+            else if (!verifyXML(repaired, VerifyOptions()).valid)
+                repair.fail(printable(text) + " repaired as " + printable(repaired));
+        }
+        return repair.report();
+    }
+
+    bool checkParallelVerifier(const CheckOptions &options)
+    {
+        CheckResult parallel("parallel verifier against sequential");
+
+        // Large enough for summarizeTagsParallel to split, with and without
+        // defects, and with the comments and CDATA of noise for splits to land in
+        for (double defects : {0.0, 0.001, 0.05})
+        {
+            for (double noise : {0.0, 0.3})
+            {
+                NetworkGeneratorOptions network;
+                network.seed = options.seed;
+                network.targetBytes = 3 << 19;
+                network.defects = defects;
+                network.noise = noise;
+                string text;
+                {
+                    OutputBuffer out(text);
+                    NetworkGenerator(network).write(out);
+                    out.close();
+                }
+
+                // Tags whose names balance but cross, spread over several chunks
+                string crossed = text;
+                crossed.insert(crossed.find('<', crossed.size() * 3 / 5), "</x></y>");
+                crossed.insert(crossed.find('<', crossed.size() * 2 / 5), "<x><y>");
+
+                for (const string *input : {&text, &crossed})
+                {
+                    VerifyResult expected = verifyXML(*input, VerifyOptions());
+                    for (unsigned threads : {2u, 4u, 7u})
+                    {
+                        VerifyOptions verify;
+                        verify.threads = threads;
+                        VerifyResult got = verifyXML(*input, verify);
+                        if (got.valid != expected.valid || got.errorCount != expected.errorCount ||
+                            !sameErrors(got.errors, expected.errors))
+                            parallel.fail(to_string(threads) + " threads with defects " + to_string(defects) +
+                                          ", noise " + to_string(noise) + (input == &crossed ? ", crossed" : "") +
+                                          ":" + describeErrors(got.errors) + " instead of" +
+                                          describeErrors(expected.errors));
+                    }
+                }
+            }
+        }
+        return parallel.report();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CheckOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--seed" && hasValue)
+        {
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--rounds" && hasValue)
+        {
+            options.rounds = strtoull(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            cerr << "Usage: xml_selfcheck [--seed n] [--rounds n]\n";
+            return 1;
+        }
+    }
+
+    cout << "Kernels: structural " << structuralKernelName() << ", JSON escape " << jsonEscapeKernelName() << "\n";
+    bool ok = checkByteMasks(options);
+    ok = checkTokenizer(options) && ok;
+    ok = checkEscapeKernels(options) && ok;
+    ok = checkMinifier(options) && ok;
+    ok = checkJsonGrouping(options) && ok;
+    ok = checkIncrementalVerifier(options) && ok;
+    ok = checkRepair(options) && ok;
+    ok = checkParallelVerifier(options) && ok;
+    return ok ? 0 : 1;
+}
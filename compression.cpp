@@ -4,6 +4,10 @@
 #include <queue>
 #include <string>
 #include <vector>
+#include <string_view>
+#include <cstring>
+
+#include "MappedFile.h"
 
 using namespace std;
 
@@ -31,20 +35,6 @@ struct HuffmanNode
     HuffmanNode(char c, int f) : ch(c), freq(f), left(nullptr), right(nullptr) {}
 };
 
-string readFile(const string &filename)
-{
-    ifstream file(filename);
-    if (!file.is_open())
-    {
-        cerr << "Error: Could not open file " << filename << endl;
-        return "";
-    }
-
-    stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
-}
-
 // Function to write the decompressed data to a file
 void writeFile(const string &filename, const string &data)
 {
@@ -107,7 +97,7 @@ void generateCodes(HuffmanNode *root, const string &str, vector<CharCode> &codes
 }
 
 // Encode input data using Huffman codes
-vector<bool> encode(const string &input, const vector<CharCode> &codes)
+vector<bool> encode(string_view input, const vector<CharCode> &codes)
 {
     vector<bool> result;
     for (char ch : input)
@@ -148,7 +138,13 @@ string decode(const vector<bool> &input, HuffmanNode *root)
 // Function to compress the input file
 void compress(const string &inputFile, const string &compressedFile)
 {
-    string inputData = readFile(inputFile);
+    MappedFile input;
+    if (!input.open(inputFile))
+    {
+        cerr << "Error: Could not open file " << inputFile << endl;
+        return;
+    }
+    string_view inputData = input.view();
     if (inputData.empty())
         return;
 
@@ -219,27 +215,44 @@ void compress(const string &inputFile, const string &compressedFile)
 // Function to decompress the compressed file
 void decompress(const string &compressedFile, const string &decompressedFile)
 {
-    ifstream file(compressedFile, ios::binary);
-    if (!file.is_open())
+    MappedFile file;
+    if (!file.open(compressedFile))
     {
         cerr << "Error: Could not open file " << compressedFile << endl;
         return;
     }
+    string_view data = file.view();
+    size_t pos = 0;
 
-    size_t numSymbols;
-    file.read(reinterpret_cast<char *>(&numSymbols), sizeof(numSymbols));
+    size_t numSymbols = 0;
+    if (data.size() < sizeof(numSymbols))
+    {
+        cerr << "Error: Invalid compressed file " << compressedFile << endl;
+        return;
+    }
+    memcpy(&numSymbols, data.data(), sizeof(numSymbols));
+    pos += sizeof(numSymbols);
+
+    size_t entrySize = 1 + sizeof(int);
+    if (numSymbols > (data.size() - pos) / entrySize)
+    {
+        cerr << "Error: Invalid compressed file " << compressedFile << endl;
+        return;
+    }
 
     vector<CharFrequency> frequencies(numSymbols);
     for (size_t i = 0; i < numSymbols; ++i)
     {
-        file.get(frequencies[i].ch);
-        file.read(reinterpret_cast<char *>(&frequencies[i].freq), sizeof(frequencies[i].freq));
+        frequencies[i].ch = data[pos];
+        memcpy(&frequencies[i].freq, data.data() + pos + 1, sizeof(frequencies[i].freq));
+        pos += entrySize;
     }
 
     vector<bool> decompressedData;
-    char byte;
-    while (file.get(byte))
+    decompressedData.reserve((data.size() - pos) * 8);
+    for (; pos < data.size(); ++pos)
     {
+        char byte = data[pos];
         for (int i = 7; i >= 0; --i)
         {
             decompressedData.push_back((byte >> i) & 1);
@@ -6,6 +6,7 @@
 #include <queue>
 #include <string>
 #include <vector>
+#include <string_view>
 
 // Structure to store character frequencies
 struct CharFrequency {
@@ -28,9 +29,6 @@ struct HuffmanNode {
     HuffmanNode(char c, int f);
 };
 
-// Reads the content of a file
-std::string readFile(const std::string& filename);
-
 // Writes decompressed data to a file
 void writeFile(const std::string& filename, const std::string& data);
 
@@ -41,7 +39,7 @@ HuffmanNode* buildHuffmanTree(const std::vector<CharFrequency>& frequencies);
 void generateCodes(HuffmanNode* root, const std::string& str, std::vector<CharCode>& codes);
 
 // Encodes input data using Huffman codes
-std::vector<bool> encode(const std::string& input, const std::vector<CharCode>& codes);
+std::vector<bool> encode(std::string_view input, const std::vector<CharCode>& codes);
 
 // Decodes binary data using the Huffman tree
 std::string decode(const std::vector<bool>& input, HuffmanNode* root);
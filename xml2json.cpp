@@ -1,118 +1,323 @@
-#include <iostream>
+#include "xml2json.h"
+#include "BinaryJson.h"
+#include "StructuralScanner.h"
+
+#include <algorithm>
 #include <fstream>
-#include <string>
-#include <stack>
-#include <vector>
-#include <cctype>
-#include <sstream>
 
 using namespace std;
 
-struct JsonNode
+bool parseJsonFormat(string_view name, JsonFormat &format)
+{
+    if (name == "json")
+        format = JsonFormat::Text;
+    else if (name == "cbor")
+        format = JsonFormat::Cbor;
+    else if (name == "msgpack")
+        format = JsonFormat::MessagePack;
+    else
+        return false;
+    return true;
+}
+
+const char *jsonFormatName(JsonFormat format)
+{
+    switch (format)
+    {
+    case JsonFormat::Cbor:
+        return "CBOR";
+    case JsonFormat::MessagePack:
+        return "MessagePack";
+    default:
+        return "JSON";
+    }
+}
+
+JsonEventWriter::JsonEventWriter(OutputBuffer &out, const JsonOptions &options, string_view input)
+    : out(out), arrayTags(options.arrayTags), depth(0), pendingEntities(false), heldSize(0), undecided(0),
+      heldLimit(options.heldLimit), input(input), position(0), hasRoot(false), skipped(0)
+{
+    out.write("{\n");
+}
+
+void JsonEventWriter::writeString(string_view value, bool hasEntities)
+{
+    size_t clean = jsonCleanPrefix(value, hasEntities);
+    emit(value.substr(0, clean));
+    if (clean == value.size())
+        return;
+    string_view rest = value.substr(clean);
+    if (escaped.size() < JSON_ESCAPE_GROWTH * rest.size())
+        escaped.resize(JSON_ESCAPE_GROWTH * rest.size());
+    emit(string_view(escaped.data(), escapeJsonString(rest, &escaped[0], hasEntities)));
+}
+
+// Two spaces for the document object, two more per level
+void JsonEventWriter::writeIndent(size_t level)
+{
+    static const string spaces(64, ' ');
+    for (size_t width = 2 + 2 * level; width > 0;)
+    {
+        size_t chunk = min(width, spaces.size());
+        emit(string_view(spaces.data(), chunk));
+        width -= chunk;
+    }
+}
+
+bool JsonEventWriter::isArrayTag(string_view name) const
+{
+    return find(arrayTags.begin(), arrayTags.end(), name) != arrayTags.end();
+}
+
+void JsonEventWriter::growHeld(size_t needed)
 {
-    string tag, value;
-    vector<JsonNode> children;
+    held.resize(max({heldSize + needed, 2 * held.size(), size_t(4096)}));
+}
 
-    string toJson(int indent = 0) const
+void JsonEventWriter::releaseHeld(OpenElement &element, bool array)
+{
+    // Everything after the value belongs to that child, so it is the only
+    // held text that moves
+    if (array)
+    {
+        if (heldSize == held.size())
+            growHeld(1);
+        memmove(&held[element.heldValue + 1], &held[element.heldValue], heldSize - element.heldValue);
+        held[element.heldValue] = '[';
+        ++heldSize;
+    }
+    element.inArray = array;
+    element.heldValue = NO_HELD_VALUE;
+    if (--undecided == 0)
     {
-        string padding(indent, ' '), result;
-        if (!tag.empty())
-            result += padding + "\"" + tag + "\": ";
-        if (!children.empty())
+        out.write(held.data(), heldSize);
+        heldSize = 0;
+    }
+}
+
+void JsonEventWriter::decideHeldRuns()
+{
+    // The outermost held run holds everything after its value, the inner
+    // ones only what follows theirs
+    for (size_t level = 0; level < depth && heldSize > heldLimit; ++level)
+    {
+        if (open[level].heldValue == NO_HELD_VALUE)
+            continue;
+        bool array = siblingFollows(level);
+        if (array)
         {
-            result += "{\n";
-            for (size_t i = 0; i < children.size(); ++i)
+            for (size_t inner = level + 1; inner < depth; ++inner)
             {
-                result += children[i].toJson(indent + 2);
-                if (i < children.size() - 1)
-                    result += ",";
-                result += "\n";
+                if (open[inner].heldValue != NO_HELD_VALUE)
+                    ++open[inner].heldValue;
             }
-            result += padding + "}";
         }
-        else
+        releaseHeld(open[level], array);
+        if (undecided == 0)
+            return;
+
+        // Up to the next held value nothing is undecided any more
+        size_t ready = heldSize;
+        for (size_t inner = level + 1; inner < depth; ++inner)
+            ready = min(ready, open[inner].heldValue);
+        out.write(held.data(), ready);
+        memmove(&held[0], &held[ready], heldSize - ready);
+        heldSize -= ready;
+        for (size_t inner = level + 1; inner < depth; ++inner)
+        {
+            if (open[inner].heldValue != NO_HELD_VALUE)
+                open[inner].heldValue -= ready;
+        }
+    }
+}
+
+bool JsonEventWriter::siblingFollows(size_t level) const
+{
+    // Counts open elements as startElement and endElement do, up to the
+    // next child of open[level] or its end tag
+    size_t openCount = depth, pos = position;
+    StructuralScanner scanner(input);
+    XmlToken token;
+    while (scanXmlToken(input, pos, true, token, &scanner))
+    {
+        if (token.type == XmlTokenType::StartTag || token.type == XmlTokenType::SelfClosingTag)
+        {
+            if (openCount == level + 1)
+                return token.name == open[level].lastChild;
+            if (token.type == XmlTokenType::StartTag)
+                ++openCount;
+        }
+        else if (token.type == XmlTokenType::EndTag)
         {
-            result += "\"" + value + "\"";
+            if (openCount == level + 1)
+                return false;
+            --openCount;
         }
-        return result;
     }
-};
+    return false;
+}
 
-// Converts XML to JSON
-class XmlToJsonConverter
+void JsonEventWriter::startElement(string_view name)
 {
-public:
-    string convertToJson(const string &xml)
+    // Top-level elements after the root are dropped with their content
+    if (depth == 0 && hasRoot)
     {
-        stack<JsonNode> nodes;
-        JsonNode root;
-        string tag, value;
-        bool insideTag = false, closingTag = false;
+        ++skipped;
+        return;
+    }
+
+    if (depth > 0)
+    {
+        OpenElement &parent = open[depth - 1];
+        bool sameRun = parent.hasChildren && parent.lastChild == name;
+        settleRun(parent, sameRun);
 
-        for (char ch : xml)
+        if (sameRun && parent.inArray)
         {
-            if (ch == '<')
-            {
-                if (!value.empty())
-                {
-                    trim(value);
-                    if (!value.empty() && !nodes.empty())
-                        nodes.top().value = value;
-                    value.clear();
-                }
-                insideTag = true;
-                closingTag = false;
-            }
-            else if (ch == '>')
-            {
-                insideTag = false;
-                if (closingTag)
-                {
-                    JsonNode completed = nodes.top();
-                    nodes.pop();
-                    if (!nodes.empty())
-                        nodes.top().children.push_back(completed);
-                    else
-                        root = completed;
-                }
-                else
-                {
-                    nodes.push(JsonNode{tag});
-                }
-                tag.clear();
-            }
-            else if (insideTag)
+            emit(", ");
+        }
+        else
+        {
+            if (parent.inArray)
+                emit(']');
+            parent.inArray = false;
+            // The first child makes the parent an object and drops its text
+            emit(parent.hasChildren ? ",\n" : "{\n");
+            parent.hasChildren = true;
+            writeIndent(depth);
+            emit('"');
+            writeString(name, false);
+            emit("\": ");
+
+            if (isArrayTag(name))
             {
-                if (ch == '/')
-                    closingTag = true;
-                else
-                    tag += ch;
+                emit('[');
+                parent.inArray = true;
             }
             else
             {
-                value += ch;
+                // Held until the next sibling tells whether this starts an array
+                ++undecided;
+                parent.heldValue = heldSize;
             }
+            parent.lastChild.assign(name.data(), name.size());
         }
-        return "{\n" + root.toJson(2) + "\n}";
+    }
+    else
+    {
+        writeIndent(0);
+        emit('"');
+        writeString(name, false);
+        emit("\": ");
     }
 
-    void saveToFile(const string &json, const string &filename)
+    if (depth == open.size())
+        open.emplace_back();
+    OpenElement &element = open[depth++];
+    element.hasChildren = false;
+    element.inArray = false;
+    element.heldValue = NO_HELD_VALUE;
+    pendingText.clear();
+    hasRoot = true;
+}
+
+void JsonEventWriter::endElement()
+{
+    if (skipped > 0)
     {
-        ofstream file(filename);
-        if (file)
-            file << json;
-        else
-            cerr << "Error: Could not open file for writing." << endl;
+        --skipped;
+        return;
+    }
+    if (depth == 0)
+        return;
+
+    OpenElement &element = open[depth - 1];
+    // No sibling follows the last child
+    settleRun(element, false);
+    if (element.inArray)
+        emit(']');
+
+    if (element.hasChildren)
+    {
+        emit('\n');
+        writeIndent(depth - 1);
+        emit('}');
+    }
+    else
+    {
+        emit('"');
+        writeString(pendingText, pendingEntities);
+        emit('"');
     }
+    --depth;
+    pendingText.clear();
+}
+
+void JsonEventWriter::finish()
+{
+    skipped = 0;
+    while (depth > 0)
+        endElement();
+    // A document without elements is an empty object
+    out.write(hasRoot ? "\n}" : "}");
+}
+
+string XmlToJsonConverter::convertToJson(string_view xml)
+{
+    string result;
+    convertToJson(xml, result);
+    return result;
+}
 
-private:
-    void trim(string &str)
+void XmlToJsonConverter::convertToJson(string_view xml, string &result)
+{
+    result.clear();
+    OutputBuffer out(result);
+    convertToJson(xml, out);
+    out.flush();
+}
+
+bool XmlToJsonConverter::convertToJson(string_view xml, OutputBuffer &out)
+{
+    if (options.format != JsonFormat::Text)
     {
-        size_t start = 0, end = str.size();
-        while (start < end && isspace(str[start]))
-            ++start;
-        while (end > start && isspace(str[end - 1]))
-            --end;
-        str = str.substr(start, end - start);
+        vector<uint32_t> sizes;
+        measureJsonContainers(xml, sizes);
+        BinaryJsonWriter writer(out, options, sizes);
+        XmlTokenizer tokenizer(xml);
+        XmlToken token;
+        while (tokenizer.next(token))
+            writer.consume(token);
+        writer.finish();
+        return !out.failed();
     }
-};
\ No newline at end of file
+
+    JsonEventWriter writer(out, options, xml);
+    XmlTokenizer tokenizer(xml);
+    XmlToken token;
+    while (tokenizer.next(token))
+        writer.consume(token);
+    writer.finish();
+    return !out.failed();
+}
+
+void XmlToJsonConverter::convertStream(istream &in, ostream &out)
+{
+    OutputBuffer buffer(out, XML_STREAM_CHUNK_SIZE);
+    JsonEventWriter writer(buffer, options);
+    XmlStreamTokenizer tokenizer(in);
+    XmlToken token;
+    while (tokenizer.next(token))
+        writer.consume(token);
+    writer.finish();
+    buffer.flush();
+}
+
+void XmlToJsonConverter::saveToFile(const string &json, const string &filename)
+{
+    ofstream file(filename);
+    if (file)
+        file << json;
+    else
+        cerr << "Error: Could not open file for writing." << endl;
+}
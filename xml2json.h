@@ -0,0 +1,193 @@
+#ifndef XML2JSON_H
+#define XML2JSON_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "JsonEscape.h"
+#include "OutputBuffer.h"
+#include "XmlTokenizer.h"
+
+using namespace std;
+
+// Encoding of the json command's output. The binary forms carry the same
+// objects, arrays and strings as the text.
+enum class JsonFormat
+{
+    Text,
+    Cbor,
+    MessagePack,
+};
+
+// "json", "cbor" or "msgpack"; false for any other name
+bool parseJsonFormat(string_view name, JsonFormat &format);
+// Name shown to the user, such as "CBOR"
+const char *jsonFormatName(JsonFormat format);
+
+struct JsonOptions
+{
+    // Tags that are always arrays, even when they occur once. Runs of any
+    // other same-name siblings are still grouped into arrays.
+    vector<string> arrayTags;
+    // Whether an unlisted child starts an array is known only at its next
+    // sibling, so its whole value is held until then. At worst that is the
+    // largest child first in its run, such as all of a root's only child.
+    // When the whole input is at hand, a run held past this many bytes is
+    // decided by reading ahead in the input instead; a stream cannot be.
+    size_t heldLimit = 1 << 20;
+    JsonFormat format = JsonFormat::Text;
+};
+
+// Writes the JSON form of an element tree as its XML events arrive: one
+// object per element with children, the last text of an element without
+// any, and an array for each run of same-name siblings. Whether an element
+// is an object is known at its first child or its end tag, so only the
+// latest text of the innermost element is kept for it. Whether a child
+// starts an array is known at its next sibling, so its value is held until
+// then and "[" put in front if the sibling has the same name. Held output
+// is written out as soon as nothing is undecided, or past heldLimit when
+// input holds the whole document the tokens come from.
+class JsonEventWriter
+{
+public:
+    JsonEventWriter(OutputBuffer &out, const JsonOptions &options = JsonOptions(), string_view input = string_view());
+
+    void consume(const XmlToken &token)
+    {
+        position = token.offset + token.raw.size();
+        switch (token.type)
+        {
+        case XmlTokenType::StartTag:
+            startElement(token.name);
+            break;
+        case XmlTokenType::SelfClosingTag:
+            startElement(token.name);
+            endElement();
+            break;
+        case XmlTokenType::EndTag:
+            endElement();
+            break;
+        case XmlTokenType::Text:
+            text(trimWhitespace(token.raw), true);
+            break;
+        case XmlTokenType::CData:
+            text(cdataContent(token.raw), false);
+            break;
+        default:
+            break;
+        }
+        if (heldSize > heldLimit && !input.empty())
+            decideHeldRuns();
+    }
+    void startElement(string_view name);
+    // Character data; entities are decoded in text but not in CDATA
+    void text(string_view value, bool hasEntities)
+    {
+        // Only the innermost element can still turn out to be a scalar
+        if (!value.empty() && depth > 0 && !open[depth - 1].hasChildren)
+        {
+            pendingText.assign(value.data(), value.size());
+            pendingEntities = hasEntities;
+        }
+    }
+    void endElement();
+    // Closes every element left open and the document object
+    void finish();
+
+private:
+    // heldValue of an element whose latest run is settled
+    static constexpr size_t NO_HELD_VALUE = SIZE_MAX;
+
+    struct OpenElement
+    {
+        bool hasChildren;
+        bool inArray;      // the latest run of children is an open array
+        size_t heldValue;  // offset in held of the latest child's value while its run is undecided
+        string lastChild;  // name of the latest child
+    };
+
+    void emit(string_view text)
+    {
+        if (undecided == 0)
+        {
+            out.write(text);
+            return;
+        }
+        if (held.size() - heldSize < text.size())
+            growHeld(text.size());
+        memcpy(&held[heldSize], text.data(), text.size());
+        heldSize += text.size();
+    }
+    void emit(char c)
+    {
+        if (undecided == 0)
+        {
+            out.put(c);
+            return;
+        }
+        if (heldSize == held.size())
+            growHeld(1);
+        held[heldSize++] = c;
+    }
+    void growHeld(size_t needed);
+    // Writes value escaped for a JSON string, clean text as it is
+    void writeString(string_view value, bool hasEntities);
+    void writeIndent(size_t depth);
+    // Settles the run of the latest child of element, "[" in front if array
+    void settleRun(OpenElement &element, bool array)
+    {
+        if (element.heldValue != NO_HELD_VALUE)
+            releaseHeld(element, array);
+    }
+    void releaseHeld(OpenElement &element, bool array);
+    // Settles held runs outermost first by reading ahead in input, writing
+    // out what no longer depends on a run, until heldLimit is met
+    void decideHeldRuns();
+    bool siblingFollows(size_t level) const;
+    bool isArrayTag(string_view name) const;
+
+    OutputBuffer &out;
+    const vector<string> &arrayTags;
+    vector<OpenElement> open;
+    size_t depth;       // elements open, a prefix of open
+    string pendingText; // latest text of the innermost element
+    bool pendingEntities;
+    string escaped;     // scratch for text that needs escaping
+    string held;        // output after the first undecided run, heldSize bytes of it
+    size_t heldSize;
+    size_t undecided;   // runs held in held
+    size_t heldLimit;
+    string_view input;  // the whole document, or empty for a stream
+    size_t position;    // end of the latest token in input
+    bool hasRoot;
+    size_t skipped;     // depth inside dropped top-level elements
+};
+
+// Converts XML to JSON
+class XmlToJsonConverter
+{
+public:
+    explicit XmlToJsonConverter(const JsonOptions &options = JsonOptions()) : options(options) {}
+
+    string convertToJson(string_view xml);
+    // Replaces result with the JSON form of xml
+    void convertToJson(string_view xml, string &result);
+    // Writes the JSON form of xml to out without building a tree: text in
+    // one pass, the binary formats in two, the first counting containers.
+    // Text held for grouping stays near heldLimit.
+    bool convertToJson(string_view xml, OutputBuffer &out);
+    // Streaming form, text only: memory is bounded by the chunk size, the
+    // depth and the values held for grouping, which heldLimit cannot bound
+    void convertStream(istream &in, ostream &out);
+
+    void saveToFile(const string &json, const string &filename);
+
+private:
+    JsonOptions options;
+};
+
+#endif
@@ -1,295 +1,151 @@
-#include "Formatting.cpp"
-#include "Minifying.cpp"
-#include "XML_Consistency.cpp"
-#include "xml2json.cpp"
-#include "compression.cpp"
-#include "Graph.cpp"
-#include <sstream>
-
-using namespace std;
-
-vector<string> splitString(const string &input, char delimiter)
-{
-    vector<string> tokens;
-    stringstream ss(input);
-    string token;
-
-    while (getline(ss, token, delimiter))
-    {
-        tokens.push_back(token);
-    }
-
-    return tokens;
-}
-
-int main(int argc, char *argv[])
-{
-    if (argc < 4)
-    {
-        cerr << "Usage: xml_editor <command> -i <input_file> [-o <output_file>] [options]\n";
-        return 1;
-    }
-
-    string command = argv[1];
-    string inputFile, outputFile;
-    bool fixErrors = false;
-
-    // Parse input arguments
-    for (int i = 2; i < argc; ++i)
-    {
-        if (string(argv[i]) == "-i" && i + 1 < argc)
-        {
-            inputFile = argv[++i];
-        }
-        else if (string(argv[i]) == "-o" && i + 1 < argc)
-        {
-            outputFile = argv[++i];
-        }
-        else if (string(argv[i]) == "-f")
-        {
-            fixErrors = true;
-        }
-    }
-
-    if (inputFile.empty())
-    {
-        cerr << "Error: Input file not specified. Use -i <input_file>.\n";
-        return 1;
-    }
-
-    // Graph-related commands
-    if (command == "draw" || command == "most_active" || command == "most_influencer" || command == "mutual" || command == "suggest" || command == "search")
-    {
-        Graph network(200);
-        network.parseXML(inputFile);
-        network.exportToDot("social_network.dot");
-
-        if (command == "draw")
-        {
-            string pythonCommand = "python Graph_GUI.py";
-            if (!outputFile.empty())
-            {
-                pythonCommand += " -o \"" + outputFile + "\"";
-            }
-            int result = system(pythonCommand.c_str());
-            if (result != 0)
-            {
-                cerr << "Failed to render graph with Python script.\n";
-                return 1;
-            }
-        }
-
-        else if (command == "most_active")
-        {
-            User mostActiveUser = network.most_active();
-            cout << "Most Active User: " << mostActiveUser.name << " (ID: " << mostActiveUser.id << ")\n";
-        }
-        else if (command == "most_influencer")
-        {
-            User mostInfluencer = network.most_influencer();
-            cout << "Most Influential User: " << mostInfluencer.name << " (ID: " << mostInfluencer.id << ")\n";
-        }
-        else if (command == "mutual")
-        {
-            vector<string> userIds;
-
-            for (int i = 2; i < argc; i++)
-            {
-                if (string(argv[i]) == "-ids" && i + 1 < argc)
-                {
-                    userIds = splitString(argv[++i], ',');
-                }
-            }
-
-            vector<User> mutualFollowers = network.findMutualFollowers(userIds);
-
-            cout << "Mutual Followers:\n";
-            for (const User &user : mutualFollowers)
-            {
-                cout << user.name << " (ID: " << user.id << ")\n";
-            }
-        }
-        else if (command == "suggest")
-        {
-            string userId;
-
-            for (int i = 2; i < argc; i++)
-            {
-                if (string(argv[i]) == "-id" && i + 1 < argc)
-                {
-                    userId = argv[++i];
-                }
-            }
-
-            vector<User> suggestedUsers = network.suggestFollowers(userId);
-
-            cout << "Suggested Users:\n";
-            for (const User &user : suggestedUsers)
-            {
-                cout << user.name << " (ID: " << user.id << ")\n";
-            }
-        }
-        else if (command == "search")
-        {
-            string searchTerm;
-            string searchType;
-
-            for (int i = 2; i < argc; i++)
-            {
-                if (string(argv[i]) == "-w" && i + 1 < argc)
-                {
-                    searchType = "word";
-                    searchTerm = argv[++i];
-                }
-                else if (string(argv[i]) == "-t")
-                {
-                    searchType = "topic";
-                    searchTerm.clear();
-                    for (int j = i + 1; j < argc && string(argv[j])[0] != '-'; j++, i++)
-                    {
-                        if (!searchTerm.empty())
-                            searchTerm += " ";
-                        searchTerm += argv[j];
-                    }
-                }
-            }
-
-            if (searchTerm.empty())
-            {
-                cerr << "Search term not specified. Use -w <word> or -t <topic>.\n";
-                return 1;
-            }
-
-            vector<string> matchedPosts = network.searchPosts(searchTerm);
-
-            cout << "Posts mentioning the " << searchType << " \"" << searchTerm << "\":\n";
-            for (const string &post : matchedPosts)
-            {
-                cout << post << "\n";
-            }
-        }
-
-        return 0;
-    }
-
-    // Existing XML-related commands
-    if (command == "verify")
-    {
-        string xml = readXMLFile(inputFile);
-        if (xml.empty())
-        {
-            cerr << "Error: Failed to read input file.\n";
-            return 1;
-        }
-
-        if (checkXMLConsistency(xml))
-        {
-            cout << "Output: XML is valid.\n";
-        }
-        else
-        {
-            cout << "Output: XML is invalid.\n";
-            vector<int> errors = findMismatchedTags(xml);
-            cout << "Number of errors: " << errors.size() << "\n";
-            for (int line : errors)
-            {
-                cout << "Error at line: " << line << "\n";
-            }
-            if (fixErrors && !outputFile.empty())
-            {
-                string correctedXml = correctMismatchedTags(xml, errors);
-                ofstream outFile(outputFile);
-                if (!outFile.is_open())
-                {
-                    cerr << "Error: Failed to write to output file.\n";
-                    return 1;
-                }
-                outFile << correctedXml;
-                cout << "Errors fixed. Corrected file saved as: " << outputFile << "\n";
-            }
-        }
-    }
-    else if (command == "format")
-    {
-        string xml = readXMLFile(inputFile);
-        if (xml.empty())
-        {
-            cerr << "Error: Failed to read input file.\n";
-            return 1;
-        }
-
-        string formattedXml = FormattingFunction(xml);
-        ofstream outFile(outputFile);
-        if (!outFile.is_open())
-        {
-            cerr << "Error: Failed to write to output file.\n";
-            return 1;
-        }
-        outFile << formattedXml;
-        cout << "Formatted XML saved to " << outputFile << "\n";
-    }
-    else if (command == "json")
-    {
-        string xml = readXMLFile(inputFile);
-        if (xml.empty())
-        {
-            cerr << "Error: Failed to read input file.\n";
-            return 1;
-        }
-
-        XmlToJsonConverter converter;
-        string json = converter.convertToJson(xml);
-        ofstream outFile(outputFile);
-        if (!outFile.is_open())
-        {
-            cerr << "Error: Failed to write to output file.\n";
-            return 1;
-        }
-        outFile << json;
-        cout << "Converted JSON saved to " << outputFile << "\n";
-    }
-    else if (command == "mini")
-    {
-        string xml = readXMLFile(inputFile);
-        if (xml.empty())
-        {
-            cerr << "Error: Failed to read input file.\n";
-            return 1;
-        }
-
-        string minifiedXml = MinifyingFunction(xml);
-        ofstream outFile(outputFile);
-        if (!outFile.is_open())
-        {
-            cerr << "Error: Failed to write to output file.\n";
-            return 1;
-        }
-        outFile << minifiedXml;
-        cout << "Minified XML saved to " << outputFile << "\n";
-    }
-    else if (command == "compress")
-    {
-        if (outputFile.empty())
-        {
-            cerr << "Error: Output file not specified for compression.\n";
-            return 1;
-        }
-        compress(inputFile, outputFile);
-    }
-    else if (command == "decompress")
-    {
-        if (outputFile.empty())
-        {
-            cerr << "Error: Output file not specified for decompression.\n";
-            return 1;
-        }
-        decompress(inputFile, outputFile);
-    }
-    else
-    {
-        cerr << "Invalid command.\n";
-        return 1;
-    }
-
-    return 0;
-}
+#include "MappedFile.cpp"
+#include "StructuralScanner.cpp"
+#include "LineIndex.cpp"
+#include "XmlTokenizer.cpp"
+#include "XmlDocument.cpp"
+#include "TagInterner.cpp"
+#include "XmlSchema.cpp"
+#include "TagBalance.cpp"
+#include "IncrementalVerifier.cpp"
+#include "TagRepair.cpp"
+#include "OutputBuffer.cpp"
+#include "SpanWriter.cpp"
+#include "Formatting.cpp"
+#include "Minifying.cpp"
+#include "XML_Consistency.cpp"
+#include "JsonEscape.cpp"
+#include "BinaryJson.cpp"
+#include "xml2json.cpp"
+#include "compression.cpp"
+#include "Graph.cpp"
+#include "EditorCommands.cpp"
+#include "BatchRunner.cpp"
+#include "EditorServer.cpp"
+
+using namespace std;
+
+// Other programs built on the editor, such as bench/xml_bench.cpp, include
+// this file with XML_EDITOR_NO_MAIN defined and bring their own main
+#ifndef XML_EDITOR_NO_MAIN
+int main(int argc, char *argv[])
+{
+    InputCache cache;
+
+    // Long-lived mode: requests on stdin, one JSON response per line on stdout
+    if (argc >= 2 && string(argv[1]) == "serve")
+    {
+        return serveRequests(cin, cout, cache);
+    }
+
+    if (argc < 4)
+    {
+        cerr << "Usage: xml_editor <command> -i <input_file> [-o <output_file>] [options]\n";
+        cerr << "       xml_editor format|mini|json --stream -i <input_file|-> [-o <output_file|->]\n";
+        cerr << "       xml_editor verify -i <input_file> [--threads <n>] [-f -o <output_file>]\n";
+        cerr << "       xml_editor verify -i <input_file> [--fail-fast | --max-errors <n>]\n";
+        cerr << "       xml_editor verify -i <input_file> --schema <schema_file|network>\n";
+        cerr << "       xml_editor format -i <input_file> -o <output_file> [--threads <n>] [--indent <n>] [--indent-char space|tab] [--newline lf|crlf]\n";
+        cerr << "       xml_editor mini -i <input_file> -o <output_file> [--strip-comments]\n";
+        cerr << "       xml_editor json -i <input_file> -o <output_file> [--array-tags <tag,tag,...>] [--format json|cbor|msgpack]\n";
+        cerr << "       (json --stream holds each unlisted child that starts a run until its next sibling,\n";
+        cerr << "        a root's only child whole; --array-tags starts listed tags as arrays without holding)\n";
+        cerr << "       xml_editor verify|format|mini|json -i <dir|pattern|@list> [-o <output_dir>] [--threads <n>]\n";
+        cerr << "       xml_editor serve    (line-delimited JSON requests on stdin)\n";
+        return 1;
+    }
+
+    CommandOptions options;
+    options.command = argv[1];
+
+    // Parse input arguments
+    for (int i = 2; i < argc; ++i)
+    {
+        if (string(argv[i]) == "-i" && i + 1 < argc)
+        {
+            options.inputFile = argv[++i];
+        }
+        else if (string(argv[i]) == "-o" && i + 1 < argc)
+        {
+            options.outputFile = argv[++i];
+        }
+        else if (string(argv[i]) == "-f")
+        {
+            options.fixErrors = true;
+        }
+        else if (string(argv[i]) == "--stream")
+        {
+            options.streamMode = true;
+        }
+        else if (string(argv[i]) == "--threads" && i + 1 < argc)
+        {
+            options.threads = max(1, atoi(argv[++i]));
+        }
+        else if (string(argv[i]) == "--fail-fast")
+        {
+            options.failFast = true;
+        }
+        else if (string(argv[i]) == "--max-errors" && i + 1 < argc)
+        {
+            options.maxErrors = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (string(argv[i]) == "--schema" && i + 1 < argc)
+        {
+            options.schemaFile = argv[++i];
+        }
+        else if (string(argv[i]) == "--indent" && i + 1 < argc)
+        {
+            options.formatting.indentWidth = unsigned(max(0, atoi(argv[++i])));
+        }
+        else if (string(argv[i]) == "--indent-char" && i + 1 < argc)
+        {
+            options.formatting.indentChar = string(argv[++i]) == "tab" ? '\t' : ' ';
+        }
+        else if (string(argv[i]) == "--newline" && i + 1 < argc)
+        {
+            options.formatting.newline = string(argv[++i]) == "crlf" ? "\r\n" : "\n";
+        }
+        else if (string(argv[i]) == "--strip-comments")
+        {
+            options.minifying.stripComments = true;
+        }
+        else if (string(argv[i]) == "--array-tags" && i + 1 < argc)
+        {
+            options.json.arrayTags = splitString(argv[++i], ',');
+        }
+        else if (string(argv[i]) == "--format" && i + 1 < argc)
+        {
+            if (!parseJsonFormat(argv[++i], options.json.format))
+            {
+                cerr << "Error: Unknown format " << argv[i] << ", expected json, cbor or msgpack.\n";
+                return 1;
+            }
+        }
+        else if (string(argv[i]) == "-ids" && i + 1 < argc)
+        {
+            options.userIds = splitString(argv[++i], ',');
+        }
+        else if (string(argv[i]) == "-id" && i + 1 < argc)
+        {
+            options.userId = argv[++i];
+        }
+        else if (string(argv[i]) == "-w" && i + 1 < argc)
+        {
+            options.searchType = "word";
+            options.searchTerm = argv[++i];
+        }
+        else if (string(argv[i]) == "-t")
+        {
+            options.searchType = "topic";
+            options.searchTerm.clear();
+            for (int j = i + 1; j < argc && string(argv[j])[0] != '-'; j++, i++)
+            {
+                if (!options.searchTerm.empty())
+                    options.searchTerm += " ";
+                options.searchTerm += argv[j];
+            }
+        }
+    }
+
+    return runCommand(options, cache);
+}
+#endif
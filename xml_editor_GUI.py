@@ -3,6 +3,7 @@ from ttkbootstrap.constants import *
 from tkinter import filedialog, messagebox, simpledialog
 import tkinter as tk
 import subprocess
+import json
 import os
 
 
@@ -92,6 +93,24 @@ class XMLGUI:
 
         self.xml_editor_path = "D:/Koleyaaaaa/Senior 1/Data Structures and Algorithms/Old Project/Level 1/xml_editor.exe"
 
+        # Long-lived "xml_editor serve" process, started on the first request
+        self.server = None
+
+    def send_request(self, request):
+        if self.server is None or self.server.poll() is not None:
+            self.server = subprocess.Popen(
+                [self.xml_editor_path, "serve"],
+                stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True
+            )
+
+        self.server.stdin.write(json.dumps(request) + "\n")
+        self.server.stdin.flush()
+        response = self.server.stdout.readline()
+        if not response:
+            self.server = None
+            raise RuntimeError("xml_editor server stopped unexpectedly")
+        return json.loads(response)
+
     def display_output(self, stdout, stderr):
         self.output_text.config(state="normal")
         self.output_text.delete(1.0, tk.END)
@@ -129,7 +148,7 @@ class XMLGUI:
         self.run_xml_editor_command("verify")
 
     def fix_errors(self):
-        self.run_xml_editor_command("verify", extra_args=["-f"])
+        self.run_xml_editor_command("verify", extra_args={"fix": True})
 
     def format_xml(self):
         self.run_xml_editor_command("format")
@@ -163,11 +182,11 @@ class XMLGUI:
             messagebox.showerror("Error", "The xml_editor executable was not found! Ensure it is compiled and in the correct directory.")
             return
 
-        args = [self.xml_editor_path, "decompress", "-i", input_file, "-o", output_file]
+        request = {"command": "decompress", "input": input_file, "output": output_file}
 
         try:
-            process = subprocess.run(args, capture_output=True, text=True)
-            self.display_output(process.stdout, process.stderr)
+            response = self.send_request(request)
+            self.display_output(response["stdout"], response["stderr"])
 
             if os.path.exists(output_file):
                 try:
@@ -182,18 +201,18 @@ class XMLGUI:
     def run_mutual_followers(self):
         user_ids = simpledialog.askstring("Input", "Enter user IDs (comma-separated):")
         if user_ids:
-            self.run_xml_editor_command("mutual", extra_args=["-ids", user_ids])
+            self.run_xml_editor_command("mutual", extra_args={"ids": user_ids})
 
     def run_suggest_followers(self):
         user_id = simpledialog.askstring("Input", "Enter user ID:")
         if user_id:
-            self.run_xml_editor_command("suggest", extra_args=["-id", user_id])
+            self.run_xml_editor_command("suggest", extra_args={"user": user_id})
 
     def run_search_posts(self):
         search_type = simpledialog.askstring("Input", "Enter search type ('word' or 'topic'):")
         search_term = simpledialog.askstring("Input", f"Enter search {search_type}:")
         if search_type and search_term:
-            extra_args = [f"-{search_type[0]}", search_term]
+            extra_args = {"word" if search_type.startswith("w") else "topic": search_term}
             self.run_xml_editor_command("search", extra_args=extra_args)
 
     def run_xml_editor_command(self, command, extra_args=None, output_extension=".xml"):
@@ -210,7 +229,7 @@ class XMLGUI:
         if command == "draw":
             output_extension = ".jpg"
 
-        if command in commands_requiring_output or (command == "verify" and extra_args and "-f" in extra_args):
+        if command in commands_requiring_output or (command == "verify" and extra_args and extra_args.get("fix")):
             output_file = filedialog.asksaveasfilename(
                 defaultextension=output_extension,
                 filetypes=[(f"{output_extension.upper()} files", f"*{output_extension}")]
@@ -222,15 +241,15 @@ class XMLGUI:
             messagebox.showerror("Error", "The xml_editor executable was not found! Ensure it is compiled and in the correct directory.")
             return
 
-        args = [self.xml_editor_path, command, "-i", input_file]
+        request = {"command": command, "input": input_file}
         if output_file:
-            args.extend(["-o", output_file])
+            request["output"] = output_file
         if extra_args:
-            args.extend(extra_args)
+            request.update(extra_args)
 
         try:
-            process = subprocess.run(args, capture_output=True, text=True)
-            self.display_output(process.stdout, process.stderr)
+            response = self.send_request(request)
+            self.display_output(response["stdout"], response["stderr"])
 
             # For "draw", skip displaying the file content as it is an image
             if command == "draw":
@@ -0,0 +1,95 @@
+// Writes synthetic social-network documents for load testing.
+//
+//   g++ -std=c++17 -O2 xml_generator.cpp -o xml_generator
+//   ./xml_generator -o <output_file|-> [--users n | --size 10G] [--seed n]
+//                   [--posts min-max] [--words min-max] [--vocabulary n]
+//                   [--follower-exponent a] [--max-followers n]
+//                   [--noise p] [--defects p] [--root network|users]
+//
+// The same options and seed always give the same bytes. A summary of what
+// was written, injected defects included, goes to stderr.
+
+#include "OutputBuffer.cpp"
+#include "NetworkGenerator.cpp"
+
+#include <iostream>
+
+using namespace std;
+
+// "2-5" -> 2 and 5, "3" -> 3 and 3
+static bool parseRange(const string &text, size_t &low, size_t &high)
+{
+    size_t dash = text.find('-');
+    if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+    low = strtoull(text.c_str(), nullptr, 10);
+    high = dash == string::npos ? low : strtoull(text.c_str() + dash + 1, nullptr, 10);
+    return low <= high;
+}
+
+int main(int argc, char *argv[])
+{
+    NetworkGeneratorOptions options;
+    string outputFile;
+
+    bool valid = true;
+    for (int i = 1; i < argc && valid; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-o" && hasValue)
+            outputFile = argv[++i];
+        else if (arg == "--users" && hasValue)
+            options.users = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--size" && hasValue)
+            options.targetBytes = parseByteSize(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--posts" && hasValue)
+            valid = parseRange(argv[++i], options.minPosts, options.maxPosts);
+        else if (arg == "--words" && hasValue)
+            valid = parseRange(argv[++i], options.minWords, options.maxWords);
+        else if (arg == "--vocabulary" && hasValue)
+            options.vocabulary = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--follower-exponent" && hasValue)
+            options.followerExponent = atof(argv[++i]);
+        else if (arg == "--max-followers" && hasValue)
+            options.maxFollowers = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--noise" && hasValue)
+            options.noise = atof(argv[++i]);
+        else if (arg == "--defects" && hasValue)
+            options.defects = atof(argv[++i]);
+        else if (arg == "--root" && hasValue)
+            options.root = argv[++i];
+        else
+            valid = false;
+    }
+
+    if (!valid || outputFile.empty())
+    {
+        cerr << "Usage: xml_generator -o <output_file|-> [--users n | --size 10G] [--seed n]\n";
+        cerr << "                     [--posts min-max] [--words min-max] [--vocabulary n]\n";
+        cerr << "                     [--follower-exponent a] [--max-followers n]\n";
+        cerr << "                     [--noise p] [--defects p] [--root network|users]\n";
+        return 1;
+    }
+
+    OutputBuffer out(cout);
+    if (outputFile != "-" && !out.openFile(outputFile))
+    {
+        cerr << "Error: cannot write " << outputFile << "\n";
+        return 1;
+    }
+
+    NetworkGenerator generator(options);
+    bool ok = generator.write(out) && out.close();
+    const NetworkGeneratorStats &stats = generator.stats();
+    cerr << "Users: " << stats.users << ", posts: " << stats.posts << ", follows: " << stats.follows
+         << ", defects: " << stats.defects << ", bytes: " << stats.bytes << "\n";
+    if (!ok)
+    {
+        cerr << "Error: writing " << outputFile << " failed\n";
+        return 1;
+    }
+    return 0;
+}